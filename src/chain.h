@@ -9,13 +9,20 @@
 #define BITCOIN_CHAIN_H
 
 #include "chainparams.h"
+#include "memusage.h"
 #include "pow.h"
 #include "primitives/block.h"
+#include "streams.h"
 #include "tinyformat.h"
 #include "uint256.h"
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 
@@ -98,8 +105,23 @@ enum BlockStatus {
     BLOCK_FAILED_VALID = 32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 64, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_HAVE_POW = 128, //! verified scrypt² proof-of-work hash stored in hashProofOfWork
+    BLOCK_SNAPSHOT = 256, //! transactions taken from a UTXO snapshot, block and undo data not available
 };
 
+/** Whether everything was read from a stream; only data streams know their end */
+template <typename Stream>
+inline bool IsStreamEnd(const Stream& s)
+{
+    return false;
+}
+
+inline bool IsStreamEnd(const CDataStream& s)
+{
+    return s.empty();
+}
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -165,7 +187,7 @@ public:
     //COutPoint prevoutStake;
     //unsigned int nStakeTime;
     //uint256 hashProofOfStake;
-    //uint256 hashProofOfWork;
+    uint256 hashProofOfWork;             // verified PoW hash, only valid if nStatus & BLOCK_HAVE_POW
     int64_t nMint;
     int64_t nMoneySupply;
     uint256 nStakeModifierV2;
@@ -181,9 +203,10 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+    //! zerocoin specific fields, one slot per denomination in libzerocoin::zerocoinDenomList order.
+    //! Fixed arrays rather than a map and a vector, which cost several heap nodes per block.
+    int64_t nZerocoinSupply[libzerocoin::ZEROCOIN_DENOM_COUNT]; // coins minted and not spent up to and including this block
+    uint16_t nZerocoinMints[libzerocoin::ZEROCOIN_DENOM_COUNT]; // coins minted in this block
 
     void SetNull()
     {
@@ -209,7 +232,7 @@ public:
         //prevoutStake.SetNull();
         //nStakeTime = 0;
         //hashProofOfStake = uint256();
-        //hashProofOfWork = uint256();
+        hashProofOfWork = uint256();
 
         nVersion = 0;
         hashMerkleRoot = uint256();
@@ -218,10 +241,8 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(std::make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        std::fill(nZerocoinSupply, nZerocoinSupply + libzerocoin::ZEROCOIN_DENOM_COUNT, 0);
+        ClearMints();
     }
 
     CBlockIndex()
@@ -302,7 +323,17 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return nZerocoinSupply[DenominationIndex(denom)];
+    }
+
+    void SetZcMints(libzerocoin::CoinDenomination denom, int64_t nSupply)
+    {
+        nZerocoinSupply[DenominationIndex(denom)] = nSupply;
+    }
+
+    void AddZcMints(libzerocoin::CoinDenomination denom, int64_t nChange)
+    {
+        nZerocoinSupply[DenominationIndex(denom)] += nChange;
     }
 
     /**
@@ -315,9 +346,62 @@ public:
         return libzerocoin::ZerocoinDenominationToAmount(denom) * GetZcMints(denom);
     }
 
+    bool HaveProofOfWorkHash() const
+    {
+        return (nStatus & BLOCK_HAVE_POW);
+    }
+
+    void SetProofOfWorkHash(const uint256& hash)
+    {
+        hashProofOfWork = hash;
+        nStatus |= BLOCK_HAVE_POW;
+    }
+
+    void ClearProofOfWorkHash()
+    {
+        hashProofOfWork = uint256();
+        nStatus &= ~BLOCK_HAVE_POW;
+    }
+
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return GetMintCount(denom) > 0;
+    }
+
+    //! Number of coins of this denomination minted in this block
+    unsigned int GetMintCount(libzerocoin::CoinDenomination denom) const
+    {
+        return nZerocoinMints[DenominationIndex(denom)];
+    }
+
+    bool HasMints() const
+    {
+        for (unsigned int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++) {
+            if (nZerocoinMints[i])
+                return true;
+        }
+        return false;
+    }
+
+    void AddMint(libzerocoin::CoinDenomination denom)
+    {
+        uint16_t& nMints = nZerocoinMints[DenominationIndex(denom)];
+        assert(nMints < std::numeric_limits<uint16_t>::max());
+        nMints++;
+    }
+
+    void ClearMints()
+    {
+        std::fill(nZerocoinMints, nZerocoinMints + libzerocoin::ZEROCOIN_DENOM_COUNT, 0);
+    }
+
+    //! Slot of a denomination in the zerocoin arrays; throws like the map it replaces did
+    static unsigned int DenominationIndex(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range(strprintf("invalid zerocoin denomination %d", (int)denom));
+        return nIndex;
     }
 
     uint256 GetBlockHash() const
@@ -510,6 +594,31 @@ public:
             READWRITE(vMintDenominationsInBlock);
         }*/
 
+        // Last in the record, so that versions without it still read the fields above.
+        // Records written back by such a version keep the status bit but lose the hash,
+        // and get the hash stored again the next time the header is verified.
+        if (nStatus & BLOCK_HAVE_POW) {
+            if (ser_action.ForRead() && IsStreamEnd(s))
+                nStatus &= ~BLOCK_HAVE_POW;
+            else
+                READWRITE(hashProofOfWork);
+        }
+
+    }
+
+    //! Header of the stored block, without the pprev link GetBlockHeader of CBlockIndex needs
+    CBlockHeader GetBlockHeader() const
+    {
+        CBlockHeader block;
+        block.nVersion = nVersion;
+        block.hashPrevBlock = hashPrev;
+        block.hashMerkleRoot = hashMerkleRoot;
+        block.nTime = nTime;
+        block.nBits = nBits;
+        block.nNonce = nNonce;
+        if (nVersion < Params().WALLET_UPGRADE_VERSION())
+            block.fPreForkPoS = IsProofOfStake();
+        return block;
     }
 
     uint256 GetBlockHash() const
@@ -537,6 +646,66 @@ public:
     }
 };
 
+/**
+ * Owns block index entries, carving them out of large chunks instead of
+ * allocating each one separately. Entries keep their address until Clear().
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t ENTRIES_PER_CHUNK = 4096;
+
+    std::vector<CBlockIndex*> vChunks;
+    //! entries constructed in the last chunk
+    size_t nUsedInChunk;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nUsedInChunk(ENTRIES_PER_CHUNK) {}
+
+    ~CBlockIndexArena()
+    {
+        Clear();
+    }
+
+    template <typename... Args>
+    CBlockIndex* Create(Args&&... args)
+    {
+        if (nUsedInChunk == ENTRIES_PER_CHUNK) {
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(ENTRIES_PER_CHUNK * sizeof(CBlockIndex))));
+            nUsedInChunk = 0;
+        }
+        CBlockIndex* pindex = new (vChunks.back() + nUsedInChunk) CBlockIndex(std::forward<Args>(args)...);
+        nUsedInChunk++;
+        return pindex;
+    }
+
+    //! Destroy all entries; no pointer handed out before may be used afterwards
+    void Clear()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++) {
+            size_t nEntries = (i + 1 == vChunks.size()) ? nUsedInChunk : ENTRIES_PER_CHUNK;
+            for (size_t j = 0; j < nEntries; j++)
+                vChunks[i][j].~CBlockIndex();
+            ::operator delete(vChunks[i]);
+        }
+        std::vector<CBlockIndex*>().swap(vChunks);
+        nUsedInChunk = ENTRIES_PER_CHUNK;
+    }
+
+    size_t Size() const
+    {
+        return vChunks.empty() ? 0 : (vChunks.size() - 1) * ENTRIES_PER_CHUNK + nUsedInChunk;
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return vChunks.size() * memusage::MallocUsage(ENTRIES_PER_CHUNK * sizeof(CBlockIndex)) + memusage::DynamicUsage(vChunks);
+    }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -200,6 +200,7 @@ public:
 
         nStartTreasuryBlock = nMandatoryUpgradeBlock;
         nTreasuryBlockStep = 1 * 24 * 60 * 60 / nTargetSpacing; // Once per day
+
         nMasternodeTiersStartHeight = 2100000000;
         vDevFundPubKey1 = CPubKey(ParseHex("03a728481601bb6f2e1873624fe15df816b0633b4c499406843c666800fbe45d5a"));
         vDevFundPubKey2 = CPubKey(ParseHex("0254121b1cbfcb42e0d53410f0db9c1c51fc79a0a376dd3e0d3c7431915f9fed44"));
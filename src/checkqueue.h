@@ -5,17 +5,51 @@
 #ifndef BITCOIN_CHECKQUEUE_H
 #define BITCOIN_CHECKQUEUE_H
 
+#include "utiltime.h"
+
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/** Number of work deques of a queue; threads beyond it share a deque */
+static const int MAX_CHECK_QUEUE_SLOTS = 64;
+/** Batch sizes are tuned so that a batch takes about this long to check */
+static const int64_t CHECK_BATCH_TARGET_NANOS = 500 * 1000;
+
+/** Counters of a check queue, cumulative over all the times it ran */
+struct CCheckQueueStats {
+    //! Number of Wait() calls that had checks to finish
+    uint64_t nRuns;
+    uint64_t nChecks;
+    uint64_t nBatches;
+    //! Batches taken from the deque of another thread
+    uint64_t nSteals;
+    //! Time from the first Add() of a run until its Wait() returned
+    int64_t nWallMicros;
+    //! Time spent executing checks, over all threads
+    int64_t nBusyMicros;
+    //! Thread time of the runs not spent executing checks
+    int64_t nIdleMicros;
+    //! Threads taking part, including the master
+    unsigned int nThreads;
+    //! Current batch size and the measured cost of a check it is derived from
+    unsigned int nBatchSize;
+    int64_t nCheckNanos;
+
+    CCheckQueueStats() : nRuns(0), nChecks(0), nBatches(0), nSteals(0), nWallMicros(0), nBusyMicros(0), nIdleMicros(0), nThreads(0), nBatchSize(0), nCheckNanos(0) {}
+};
+
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -24,11 +58,21 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread has its own deque with its own lock. Added checks are
+  * spread over the deques, a thread takes batches from the back of its
+  * own deque and steals half of another deque from the front when its
+  * own is empty. The batch size follows the measured cost of a check.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
+    struct CSlot {
+        boost::mutex mutex;
+        std::deque<T> deque;
+    };
+
     //! Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -38,25 +82,30 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Deque of the master, followed by those of the workers
+    CSlot vSlots[MAX_CHECK_QUEUE_SLOTS];
+
+    //! Number of deques in use
+    std::atomic<int> nSlots;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Deque the next added checks go to
+    std::atomic<unsigned int> nNextSlot;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Number of workers that registered, the master not included
+    int nWorkers;
+
+    //! Number of checks in the deques, counted before they are pushed
+    std::atomic<int64_t> nQueued;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are not anymore in queue, but still in
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<int64_t> nTodo;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -64,95 +113,191 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Moving average of the cost of a check, 0 until one was measured
+    std::atomic<int64_t> nCheckNanos;
+
+    //! Start of the current run, 0 between runs
+    int64_t nRunStart;
+
+    std::atomic<uint64_t> nChecks;
+    std::atomic<uint64_t> nBatches;
+    std::atomic<uint64_t> nSteals;
+    std::atomic<int64_t> nBusyMicros;
+    CCheckQueueStats stats;
+
+    unsigned int GetBatchSize() const
+    {
+        int64_t nCost = nCheckNanos;
+        if (nCost == 0)
+            return 1;
+        return (unsigned int)std::max((int64_t)1, std::min((int64_t)nBatchSize, CHECK_BATCH_TARGET_NANOS / nCost));
+    }
+
+    /** Move a batch from the deque of nSlot, or stolen from another one, to vChecks */
+    bool TakeBatch(int nSlot, std::vector<T>& vChecks)
+    {
+        // Do not try to do everything at once, but aim for increasingly smaller batches so
+        // all workers finish approximately simultaneously.
+        int nActive = nSlots;
+        unsigned int nWant = std::max((int64_t)1, std::min((int64_t)GetBatchSize(), nQueued / (nActive + 1)));
+        {
+            CSlot& slot = vSlots[nSlot];
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            unsigned int nNow = std::min(nWant, (unsigned int)slot.deque.size());
+            for (unsigned int i = 0; i < nNow; i++) {
+                // Swap the jobs out of the deque to keep the lock short
+                vChecks.push_back(T());
+                vChecks.back().swap(slot.deque.back());
+                slot.deque.pop_back();
+            }
+        }
+        if (vChecks.empty()) {
+            for (int i = 1; i < nActive && vChecks.empty(); i++) {
+                CSlot& slot = vSlots[(nSlot + i) % nActive];
+                boost::unique_lock<boost::mutex> lock(slot.mutex);
+                unsigned int nNow = std::min(nWant, (unsigned int)(slot.deque.size() + 1) / 2);
+                for (unsigned int j = 0; j < nNow; j++) {
+                    vChecks.push_back(T());
+                    vChecks.back().swap(slot.deque.front());
+                    slot.deque.pop_front();
+                }
+            }
+            if (!vChecks.empty())
+                nSteals++;
+        }
+        nQueued -= vChecks.size();
+        return !vChecks.empty();
+    }
+
+    /** Execute a batch and account for it */
+    void RunBatch(std::vector<T>& vChecks)
+    {
+        // Check whether we need to do work at all
+        bool fOk = fAllOk;
+        int64_t nStart = GetTimeMicros();
+        for (T& check : vChecks)
+            if (fOk)
+                fOk = check();
+        int64_t nTime = GetTimeMicros() - nStart;
+        int64_t nNow = vChecks.size();
+        vChecks.clear();
+
+        if (!fOk) {
+            fAllOk = false;
+        } else {
+            // Concurrent updates may lose a sample, which does not matter for an average
+            int64_t nCost = std::max((int64_t)1, nTime * 1000 / nNow);
+            int64_t nOld = nCheckNanos;
+            nCheckNanos = nOld == 0 ? nCost : (nOld * 7 + nCost) / 8;
+        }
+        nChecks += nNow;
+        nBatches++;
+        nBusyMicros += nTime;
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master he can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(int nSlot, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            if (TakeBatch(nSlot, vChecks)) {
+                RunBatch(vChecks);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nQueued > 0) {
+                // Checks being added are not in their deque yet
+                lock.unlock();
+                boost::this_thread::yield();
+                continue;
+            }
+            if ((fMaster || fQuit) && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                if (fMaster) {
+                    fAllOk = true;
+                    EndRun();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                // return the current status
+                return fRet;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            cond.wait(lock); // wait
         } while (true);
     }
 
+    /** Fold the counters of the finished run into stats, called with mutex held */
+    void EndRun()
+    {
+        if (nRunStart == 0)
+            return;
+        int64_t nWall = GetTimeMicros() - nRunStart;
+        int64_t nBusy = nBusyMicros.exchange(0);
+        stats.nRuns++;
+        stats.nChecks += nChecks.exchange(0);
+        stats.nBatches += nBatches.exchange(0);
+        stats.nSteals += nSteals.exchange(0);
+        stats.nWallMicros += nWall;
+        stats.nBusyMicros += nBusy;
+        stats.nIdleMicros += std::max((int64_t)0, nWall * nSlots - nBusy);
+        nRunStart = 0;
+    }
+
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nSlots(1), nNextSlot(0), nWorkers(0), nQueued(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), nCheckNanos(0), nRunStart(0), nChecks(0), nBatches(0), nSteals(0), nBusyMicros(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        int nSlot;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSlot = 1 + nWorkers++ % (MAX_CHECK_QUEUE_SLOTS - 1);
+            nSlots = std::min(nWorkers + 1, MAX_CHECK_QUEUE_SLOTS);
+        }
+        Loop(nSlot);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nRunStart == 0)
+                nRunStart = GetTimeMicros();
         }
+        // Count the checks first so that nobody finishes or sleeps before they are all in
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        int nActive = nSlots;
+        size_t nChunk = (vChecks.size() + nActive - 1) / nActive;
+        for (size_t i = 0; i < vChecks.size();) {
+            CSlot& slot = vSlots[nNextSlot++ % nActive];
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            for (size_t nEnd = std::min(i + nChunk, vChecks.size()); i < nEnd; i++) {
+                slot.deque.push_back(T());
+                vChecks[i].swap(slot.deque.back());
+            }
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -160,14 +305,26 @@ public:
     {
     }
 
+    //! Whether no run is in progress. Workers may still be on their way to sleep after the last one
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nRunStart == 0 && nTodo == 0 && nQueued == 0 && fAllOk == true);
+    }
+
+    //! Counters of the finished runs
+    CCheckQueueStats GetStats()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCheckQueueStats ret = stats;
+        ret.nThreads = nSlots;
+        ret.nBatchSize = GetBatchSize();
+        ret.nCheckNanos = nCheckNanos;
+        return ret;
     }
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
@@ -9,6 +9,8 @@
 
 //#include "chainparams.h"
 #include "compressor.h"
+#include "memusage.h"
+#include "poolallocator.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -17,6 +19,8 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <functional>
+
 #include <boost/unordered_map.hpp>
 
 /** 
@@ -284,6 +288,14 @@ public:
                 return false;
         return true;
     }
+    //! heap memory owned by the outputs and their scripts
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        for (const CTxOut& out : vout)
+            ret += memusage::DynamicUsage(out.scriptPubKey);
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -317,7 +329,10 @@ struct CCoinsCacheEntry {
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+/** Pool for the CCoinsMap nodes; blocks up to 32 pointers in size cover a node on all platforms */
+typedef CPoolResource<32 * sizeof(void*), sizeof(void*)> CCoinsMapResource;
+typedef pool_allocator<std::pair<const uint256, CCoinsCacheEntry>, 32 * sizeof(void*), sizeof(void*)> CCoinsMapAllocator;
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher, std::equal_to<uint256>, CCoinsMapAllocator> CCoinsMap;
 
 struct CCoinsStats {
     int nHeight;
@@ -370,6 +385,7 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
 };
@@ -399,7 +415,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -420,8 +437,12 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapResource cacheCoinsResource;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -447,6 +468,17 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256& txid);
 
+    //! Check whether txid has an entry in this cache, without reading it from the base view
+    bool HaveCoinsInCache(const uint256& txid) const;
+
+    /**
+     * Add coins that were read from the base view elsewhere, e.g. by another
+     * thread, as if FetchCoins had read them. Ignored if the cache already has
+     * an entry for txid. The caller must make sure the base view did not change
+     * since the coins were read.
+     */
+    void WarmCoins(const uint256& txid, CCoins& coins);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -457,6 +489,9 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the size of the cache (in bytes), including the map nodes and bucket array
+    size_t DynamicMemoryUsage() const;
+
     /** 
      * Amount of simplicity coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -11,34 +11,62 @@
 #include <condition_variable>
 #include <deque>
 
+/**
+ * FIFO queue shared between threads. A queue constructed with a maximum size
+ * makes producers wait while it is full. Once closed, pushing fails and
+ * pop(T&) returns false as soon as the remaining elements are taken.
+ */
 template <typename T>
 class concurrentqueue
 {
 private:
     std::mutex              mutex;
     std::condition_variable condition;
+    std::condition_variable conditionFull;
     std::deque<T>           queue;
+    size_t                  nMaxSize;
+    bool                    fClosed;
 
 public:
-    void push(T const& value) {
+    explicit concurrentqueue(size_t nMaxSizeIn = 0) : nMaxSize(nMaxSizeIn), fClosed(false) {}
+
+    bool push(T const& value) {
         {
             std::unique_lock<std::mutex> lock(this->mutex);
+            this->conditionFull.wait(lock, [=]{ return this->fClosed || this->nMaxSize == 0 || this->queue.size() < this->nMaxSize; });
+            if (fClosed)
+                return false;
             queue.push_front(value);
         }
         this->condition.notify_one();
+        return true;
     }
     T pop() {
         std::unique_lock<std::mutex> lock(this->mutex);
         this->condition.wait(lock, [=]{ return !this->queue.empty(); });
         T rc(std::move(this->queue.back()));
         this->queue.pop_back();
+        this->conditionFull.notify_one();
         return rc;
     }
 
+    //! Wait for an element; false once the queue is closed and empty
+    bool pop(T& value) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->condition.wait(lock, [=]{ return this->fClosed || !this->queue.empty(); });
+        if (queue.empty())
+            return false;
+        value = std::move(this->queue.back());
+        this->queue.pop_back();
+        this->conditionFull.notify_one();
+        return true;
+    }
+
     T popNotWait(){
         std::unique_lock<std::mutex> lock(this->mutex);
         T rc(std::move(this->queue.back()));
         this->queue.pop_back();
+        this->conditionFull.notify_one();
         return rc;
     }
 
@@ -46,6 +74,16 @@ public:
         std::unique_lock<std::mutex> lock(this->mutex);
         return !queue.empty();
     }
+
+    //! Wake up all waiting threads and refuse further elements
+    void close() {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            fClosed = true;
+        }
+        this->condition.notify_all();
+        this->conditionFull.notify_all();
+    }
 };
 
 #endif //SIMPLICITY_CONCURRENTQUEUE_H
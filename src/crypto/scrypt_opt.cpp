@@ -34,6 +34,15 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
 static bool HAVE_AVX2 = false;
 
 #if defined(__x86_64__)
@@ -600,6 +609,160 @@ unsigned char *scrypt_buffer_alloc(int N, bool multiWay)
     return (unsigned char*)malloc((size_t)N * (multiWay ? (HAVE_AVX2 ? 2 * SCRYPT_MAX_WAYS : SCRYPT_MAX_WAYS) : 1) * 128 + 63);
 }
 
+/* ----------- Scratchpad pool -------------------------------------------- */
+
+/* Huge page size that MAP_HUGETLB mappings are rounded up to */
+#define SCRYPT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+struct scrypt_scratchpad {
+    int N;
+    size_t size;
+    bool mapped;
+};
+
+struct scrypt_pool_state {
+    std::mutex mutex;
+    std::condition_variable cond;
+    /* All scratchpads handed out by the pool, in use or idle */
+    std::map<unsigned char *, scrypt_scratchpad> pads;
+    /* Idle scratchpads, per N */
+    std::map<int, std::vector<unsigned char *> > idle;
+    int limit;
+
+    scrypt_pool_state() : limit(0) {}
+};
+
+/* Constructed on first use (and never destroyed) so hashing during static
+   initialization or shutdown cannot hit an unconstructed pool */
+static scrypt_pool_state& scrypt_pool()
+{
+    static scrypt_pool_state *pool = new scrypt_pool_state();
+    return *pool;
+}
+
+/* Allocate a scratchpad of at least *size bytes; *size is set to the length actually mapped */
+static unsigned char *scrypt_pad_alloc(size_t *size, bool *mapped)
+{
+#ifndef WIN32
+    void *p;
+#ifdef MAP_HUGETLB
+    /* Preallocated huge pages avoid 32768 page faults per fresh 128 MB pad */
+    size_t hugesize = (*size + SCRYPT_HUGE_PAGE_SIZE - 1) & ~(size_t)(SCRYPT_HUGE_PAGE_SIZE - 1);
+    p = mmap(NULL, hugesize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *size = hugesize;
+        *mapped = true;
+        return (unsigned char *)p;
+    }
+#endif
+    p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+        /* Fall back to transparent huge pages where the kernel supports them */
+        madvise(p, *size, MADV_HUGEPAGE);
+#endif
+        *mapped = true;
+        return (unsigned char *)p;
+    }
+#endif
+    *mapped = false;
+    return (unsigned char *)malloc(*size);
+}
+
+static void scrypt_pad_free(unsigned char *scratchbuf, const scrypt_scratchpad& pad)
+{
+#ifndef WIN32
+    if (pad.mapped) {
+        munmap(scratchbuf, pad.size);
+        return;
+    }
+#endif
+    free(scratchbuf);
+}
+
+void scrypt_pool_set_limit(int nMax)
+{
+    scrypt_pool_state& pool = scrypt_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.limit = nMax;
+    pool.cond.notify_all();
+}
+
+unsigned char *scrypt_pool_acquire(int N)
+{
+    if (N < SCRYPT_POOL_MIN_N)
+        return scrypt_buffer_alloc(N, false);
+
+    scrypt_pool_state& pool = scrypt_pool();
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while (true) {
+        std::vector<unsigned char *>& idle = pool.idle[N];
+        if (!idle.empty()) {
+            unsigned char *scratchbuf = idle.back();
+            idle.pop_back();
+            return scratchbuf;
+        }
+        if (pool.limit <= 0 || (int)pool.pads.size() < pool.limit)
+            break;
+        /* Free an idle pad of another size before waiting for one to come back */
+        for (std::map<int, std::vector<unsigned char *> >::iterator it = pool.idle.begin(); it != pool.idle.end(); it++) {
+            if (!it->second.empty()) {
+                unsigned char *scratchbuf = it->second.back();
+                it->second.pop_back();
+                scrypt_pad_free(scratchbuf, pool.pads[scratchbuf]);
+                pool.pads.erase(scratchbuf);
+                break;
+            }
+        }
+        if ((int)pool.pads.size() < pool.limit)
+            break;
+        pool.cond.wait(lock);
+    }
+
+    scrypt_scratchpad pad;
+    pad.N = N;
+    pad.size = (size_t)N * 128 + 63;
+    unsigned char *scratchbuf = scrypt_pad_alloc(&pad.size, &pad.mapped);
+    if (scratchbuf)
+        pool.pads[scratchbuf] = pad;
+    return scratchbuf;
+}
+
+void scrypt_pool_release(unsigned char *scratchbuf, int N)
+{
+    if (!scratchbuf)
+        return;
+    if (N < SCRYPT_POOL_MIN_N) {
+        free(scratchbuf);
+        return;
+    }
+
+    scrypt_pool_state& pool = scrypt_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.limit > 0 && (int)pool.pads.size() > pool.limit) {
+        /* The limit was lowered while this pad was in use */
+        scrypt_pad_free(scratchbuf, pool.pads[scratchbuf]);
+        pool.pads.erase(scratchbuf);
+    } else {
+        pool.idle[N].push_back(scratchbuf);
+    }
+    pool.cond.notify_one();
+}
+
+void scrypt_pool_trim(int nKeep)
+{
+    scrypt_pool_state& pool = scrypt_pool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (std::map<int, std::vector<unsigned char *> >::iterator it = pool.idle.begin(); it != pool.idle.end(); it++) {
+        while ((int)it->second.size() > nKeep) {
+            unsigned char *scratchbuf = it->second.back();
+            it->second.pop_back();
+            scrypt_pad_free(scratchbuf, pool.pads[scratchbuf]);
+            pool.pads.erase(scratchbuf);
+        }
+    }
+}
+
 static void scrypt_N_1_1_256(const uint32_t *input,
     uint32_t *output, uint32_t *midstate, unsigned char *scratchpad, int N)
 {
@@ -864,7 +1027,7 @@ bool scryptHash(const void *input, char *output, int N)
 {
     uint32_t midstate[8];
     uint32_t data[20];
-    unsigned char *scratchbuf = scrypt_buffer_alloc(N, false);
+    unsigned char *scratchbuf = scrypt_pool_acquire(N);
 
     memset(output, 0, 32);
     if (!scratchbuf)
@@ -878,6 +1041,6 @@ bool scryptHash(const void *input, char *output, int N)
 
     scrypt_N_1_1_256(data, (uint32_t*)output, midstate, scratchbuf, N);
 
-    free(scratchbuf);
+    scrypt_pool_release(scratchbuf, N);
     return true;
 }
\ No newline at end of file
@@ -25,6 +25,17 @@ bool scrypt_N_1_1_256_multi(void *input, uint256 hashTarget, int *nHashesDone, u
 
 bool scryptHash(const void *input, char *output, int N);
 extern unsigned char *scrypt_buffer_alloc(int N, bool multiWay = true);
+
+/** Smallest N whose single-way scratchpads (8 MB and up) are kept in the pool */
+static const int SCRYPT_POOL_MIN_N = 65536;
+/** Limit the number of pooled scratchpads that exist at the same time (0 = no limit) */
+void scrypt_pool_set_limit(int nMax);
+/** Take a single-way scratchpad from the pool, allocating one or waiting for one to be released if needed */
+unsigned char *scrypt_pool_acquire(int N);
+/** Return a scratchpad obtained from scrypt_pool_acquire */
+void scrypt_pool_release(unsigned char *scratchbuf, int N);
+/** Free idle pooled scratchpads until at most nKeep of each size are left */
+void scrypt_pool_trim(int nKeep);
 extern "C" void scrypt_core(uint32_t *X, uint32_t *V, int N);
 void sha256_init(uint32_t *state);
 extern "C" void sha256_transform(uint32_t *state, const uint32_t *block, int swap);
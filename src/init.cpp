@@ -39,6 +39,7 @@
 #include "guiinterface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 #include "zspl/accumulatorcheckpoints.h"
 #include "zsplchain.h"
@@ -166,7 +167,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -238,6 +238,8 @@ void PrepareShutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsflusher;
+        pcoinsflusher = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -290,7 +292,7 @@ void Shutdown()
     // Shutdown part 2: Stop TOR thread and delete wallet instance
     StopTorControl();
     // Shutdown witness thread if it's enabled
-    if (nLocalServices == NODE_BLOOM_LIGHT_ZC) {
+    if (nLocalServices & NODE_BLOOM_LIGHT_ZC) {
         lightWorker.StopLightZsplThread();
     }
 #ifdef ENABLE_WALLET
@@ -389,6 +391,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write the coin database in the background instead of stalling validation while it is flushed (default: %u)"), DEFAULT_ASYNC_COINS_FLUSH));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
@@ -403,10 +406,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parpow=<n>", strprintf(_("Set the number of threads checking scrypt² header proofs of work, each using 128 MB while busy (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_POWCHECK_THREADS, DEFAULT_POWCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parprefetch=<n>", strprintf(_("Set the number of threads reading the inputs of a block from the coin database before it is connected (0 to %d, <= 1 = off, default: %d)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d). Zerocoin spends are verified by another pool of the same size, up to %d threads"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS, MAX_SPENDCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "simplicityd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet rescans and is incompatible with -txindex. "
+                                                         "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+                                                         "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the SPL and zSPL money supply statistics") + " " + _("on startup"));
@@ -415,6 +423,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-verifypowhashes", strprintf(_("Re-verify stored scrypt² proof-of-work hashes in the background and add missing ones (default: %u)"), DEFAULT_VERIFY_POW_HASHES));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -438,6 +447,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilterszc", strprintf(_("Support the zerocoin light node protocol (default: %u)"), DEFAULT_PEERBLOOMFILTERS_ZC));
+    strUsage += HelpMessageOpt("-lightzsplthreads=<n>", strprintf(_("Set the number of threads computing witnesses for zerocoin light nodes (1 to %d, default: %d)"), MAX_LIGHT_ZSPL_THREADS, DEFAULT_LIGHT_ZSPL_THREADS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 11957, 21957));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
@@ -528,7 +538,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u, maximum: %d)"), DEFAULT_MAX_SIG_CACHE_SIZE, MAX_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in SPL/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -571,8 +581,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zeromintpercentage=<n>", strprintf(_("Percentage of automatically minted Zerocoin  (1-100, default: %u)"), 10));
     strUsage += HelpMessageOpt("-preferredDenom=<n>", strprintf(_("Preferred Denomination for automatically minted Zerocoin  (1/5/10/50/100/500/1000/5000), 0 for no preference. default: %u)"), 0));
     strUsage += HelpMessageOpt("-backupzspl=<n>", strprintf(_("Enable automatic wallet backups triggered after each zSPL minting (0-1, default: %u)"), 1));
-    strUsage += HelpMessageOpt("-precompute=<n>", strprintf(_("Enable precomputation of zSPL spends and stakes (0-1, default %u)"), 1));
-    strUsage += HelpMessageOpt("-precomputecachelength=<n>", strprintf(_("Set the number of included blocks to precompute per cycle. (minimum: %d) (maximum: %d) (default: %d)"), MIN_PRECOMPUTE_LENGTH, MAX_PRECOMPUTE_LENGTH, DEFAULT_PRECOMPUTE_LENGTH));
+    strUsage += HelpMessageOpt("-precompute=<n>", strprintf(_("Enable precomputation of zSPL spends and stakes (0-1, default %u)"), DEFAULT_PRECOMPUTE));
     strUsage += HelpMessageOpt("-zsplbackuppath=<dir|file>", _("Specify custom backup path to add a copy of any automatic zSPL backup. If set as dir, every backup generates a timestamped file. If set as file, will rewrite to that file every backup. If backuppath is set as well, 4 backups will happen"));
 #endif // ENABLE_WALLET
     strUsage += HelpMessageOpt("-reindexzerocoin=<n>", strprintf(_("Delete all zerocoin spends and mints that have been recorded to the blockchain database and reindex them (0-1, default: %u)"), 0));
@@ -900,6 +909,18 @@ bool AppInit2()
             LogPrintf("AppInit2 : parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n");
     }
 
+    // if using block pruning, then disable txindex
+    if (GetArg("-prune", 0)) {
+        if (mapArgs.count("-txindex") && GetBoolArg("-txindex", true))
+            return InitError(_("Prune mode is incompatible with -txindex."));
+        if (SoftSetBoolArg("-txindex", false))
+            LogPrintf("AppInit2 : parameter interaction: -prune=<n> -> setting -txindex=0\n");
+#ifdef ENABLE_WALLET
+        if (GetBoolArg("-rescan", false))
+            return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
+#endif
+    }
+
     if (!GetBoolArg("-enableswifttx", fEnableSwiftTX)) {
         if (SoftSetArg("-swifttxdepth", "0"))
             LogPrintf("AppInit2 : parameter interaction: -enableswifttx=false -> setting -nSwiftTXDepth=0\n");
@@ -951,6 +972,14 @@ bool AppInit2()
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    // -maxsigcachesize used to count signature cache entries, such a value would now ask for gigabytes
+    if (GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) > MAX_MAX_SIG_CACHE_SIZE) {
+        InitWarning(strprintf(_("Warning: -maxsigcachesize is given in MiB, the value %s is above the maximum of %d and ignored."), mapArgs["-maxsigcachesize"], MAX_MAX_SIG_CACHE_SIZE));
+        mapArgs["-maxsigcachesize"] = strprintf("%u", DEFAULT_MAX_SIG_CACHE_SIZE);
+    }
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -960,6 +989,38 @@ bool AppInit2()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -parpow=0 picks at most DEFAULT_MAX_AUTO_POWCHECK_THREADS, as every thread needs a scrypt² scratchpad
+    nPoWCheckThreads = GetArg("-parpow", DEFAULT_POWCHECK_THREADS);
+    if (nPoWCheckThreads == 0)
+        nPoWCheckThreads = std::min((int)boost::thread::hardware_concurrency(), DEFAULT_MAX_AUTO_POWCHECK_THREADS);
+    else if (nPoWCheckThreads < 0)
+        nPoWCheckThreads += boost::thread::hardware_concurrency();
+    if (nPoWCheckThreads <= 1)
+        nPoWCheckThreads = 0;
+    else if (nPoWCheckThreads > MAX_POWCHECK_THREADS)
+        nPoWCheckThreads = MAX_POWCHECK_THREADS;
+    // One scratchpad per PoW check thread, plus two for other threads hashing at the same time
+    scrypt_pool_set_limit(std::max(nPoWCheckThreads, 1) + 2);
+
+    // Prefetching is I/O bound, so the default does not depend on the number of cores
+    nPrefetchThreads = GetArg("-parprefetch", DEFAULT_PREFETCH_THREADS);
+    if (nPrefetchThreads <= 1)
+        nPrefetchThreads = 0;
+    else if (nPrefetchThreads > MAX_PREFETCH_THREADS)
+        nPrefetchThreads = MAX_PREFETCH_THREADS;
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0)
+        return InitError(_("Prune cannot be configured with a negative value."));
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES)
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
     // Staking needs a CWallet instance, so make sure wallet is enabled
@@ -1100,6 +1161,24 @@ bool AppInit2()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // Blocks hold few zerocoin spends, so their pool is smaller than the script check one
+    int nSpendCheckThreads = std::min(nScriptCheckThreads, MAX_SPENDCHECK_THREADS);
+    LogPrintf("Using %u threads for zerocoin spend verification\n", nSpendCheckThreads);
+    for (int i = 0; i < nSpendCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadZerocoinSpendCheck);
+
+    LogPrintf("Using %u threads for header proof-of-work verification\n", nPoWCheckThreads);
+    if (nPoWCheckThreads) {
+        for (int i = 0; i < nPoWCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadPoWCheck);
+    }
+
+    LogPrintf("Using %u threads for block input prefetching\n", nPrefetchThreads);
+    if (nPrefetchThreads) {
+        for (int i = 0; i < nPrefetchThreads - 1; i++)
+            threadGroup.create_thread(&ThreadPrefetchInputs);
+    }
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1433,7 +1512,7 @@ bool AppInit2()
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache; // the rest goes to the in-memory coins cache, measured in bytes
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1448,12 +1527,27 @@ bool AppInit2()
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsflusher;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
                 delete zerocoinDB;
                 delete pSporkDB;
 
+                // Keep the proof-of-work hashes verified by the old block index, so
+                // reindexing does not have to recompute scrypt² for every block
+                if (fReindex) {
+                    try {
+                        std::map<uint256, uint256> mapPoWHashes;
+                        CBlockTreeDB blocktreeOld(nBlockTreeDBCache, false, false);
+                        if (blocktreeOld.ReadProofOfWorkHashes(mapPoWHashes))
+                            AddVerifiedPoWHashes(mapPoWHashes);
+                        LogPrintf("Kept %u proof-of-work hashes from the old block index\n", mapPoWHashes.size());
+                    } catch (const std::exception& e) {
+                        LogPrintf("Could not read proof-of-work hashes from the old block index: %s\n", e.what());
+                    }
+                }
+
                 //Simplicity specific: zerocoin and spork DB's
                 zerocoinDB = new CZerocoinDB(0, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
@@ -1461,7 +1555,8 @@ bool AppInit2()
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsflusher = new CCoinsViewFlusher(pcoinscatcher, pcoinsdbview);
+                pcoinsTip = new CCoinsViewCache(pcoinsflusher);
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
@@ -1469,6 +1564,13 @@ bool AppInit2()
                 // End loop if shutdown was requested
                 if (ShutdownRequested()) break;
 
+                // Convert a chainstate with per-transaction records, left by an older version
+                if (!pcoinsdbview->Upgrade()) {
+                    if (ShutdownRequested()) break;
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 // Simplicity: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
@@ -1499,6 +1601,19 @@ bool AppInit2()
                     break;
                 }
 
+                // Check for changed -prune state. What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
+                // Recomputing statistics from old blocks needs every block file
+                if (fHavePruned && (GetBoolArg("-reindexzerocoin", false) || GetBoolArg("-reindexmoneysupply", false) || GetBoolArg("-reindexaccumulators", false))) {
+                    strLoadError = _("Block files have been pruned, -reindexzerocoin, -reindexmoneysupply and -reindexaccumulators need -reindex");
+                    break;
+                }
+
                 // Populate list of invalid/fraudulent outpoints that are banned from the chain
                 invalid_out::LoadOutpoints();
                 invalid_out::LoadSerials();
@@ -1515,6 +1630,14 @@ bool AppInit2()
                     }
                 }
 
+                // Witnesses and pruning rely on the pubcoins of every block being indexed, and
+                // the mint counts of the block index, which are not stored with it, come from there
+                if (!IndexBlockPubcoins() || !zerocoinDB->LoadBlockMintCounts()) {
+                    if (ShutdownRequested()) break;
+                    strLoadError = _("Error indexing zerocoin mints");
+                    break;
+                }
+
                 // Recalculate money supply for blocks that are impacted by accounting issue after zerocoin activation
                 if (GetBoolArg("-reindexmoneysupply", false)) {
                     if (chainActive.Height() > Params().Zerocoin_StartHeight()) {
@@ -1713,6 +1836,18 @@ bool AppInit2()
                 pindexRescan = chainActive.Genesis();
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+            //We can't rescan beyond non-pruned blocks, stop and throw an error
+            //this might happen if a user uses a old wallet within a pruned node
+            // or if the wallet was disabled with -disablewallet for a longer time and then re-enabled
+            if (fPruneMode) {
+                CBlockIndex* block = chainActive.Tip();
+                while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && pindexRescan != block)
+                    block = block->pprev;
+
+                if (pindexRescan != block)
+                    return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            }
+
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
             const int64_t nWalletRescanTime = GetTimeMillis();
@@ -1763,12 +1898,25 @@ bool AppInit2()
 #endif // !ENABLE_WALLET
     // ********************************************************* Step 9: import blocks
 
+    // if prune mode, unset NODE_NETWORK and prune block files
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices &= ~NODE_NETWORK;
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     if (mapArgs.count("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
     if (mapArgs.count("-blocksizenotify"))
         uiInterface.NotifyBlockSize.connect(BlockSizeNotifyCallback);
 
+    if (GetBoolArg("-asyncflush", DEFAULT_ASYNC_COINS_FLUSH))
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "coinsflush", &ThreadFlushCoins));
+
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
     CValidationState state;
     if (!ActivateBestChain(state))
@@ -1780,6 +1928,9 @@ bool AppInit2()
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (GetBoolArg("-verifypowhashes", DEFAULT_VERIFY_POW_HASHES) && !fReindex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "powcheck", &ThreadVerifyPoWHashes));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "snapcheck", &ThreadValidateSnapshot));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1990,8 +2141,8 @@ bool AppInit2()
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
 
-        if (GetBoolArg("-precompute", false)) {
-            // Run a thread to precompute any zSPL spends
+        if (GetBoolArg("-precompute", DEFAULT_PRECOMPUTE)) {
+            // Run a thread that advances the witnesses of zSPL mints with every new block
             threadGroup.create_thread(boost::bind(&ThreadPrecomputeSpends));
         }
 
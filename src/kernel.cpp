@@ -445,18 +445,25 @@ bool initStakeInput(const CBlock block, std::unique_ptr<CStakeInput>& stake, int
         // First try finding the previous transaction in database
         uint256 hashBlock;
         CTransaction txPrev;
-        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-            return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
-                         __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+        CSplStake* splInput = new CSplStake();
+        stake = std::unique_ptr<CStakeInput>(splInput);
+        CTxOut outPrev;
+        if (GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
+            outPrev = txPrev.vout[txin.prevout.n];
+            splInput->SetInput(txPrev, txin.prevout.n);
+        } else {
+            // With pruned block files the staked output is only left in the coins view
+            CBlockIndex* pindexPrev = NULL;
+            if (!GetUnspentOutput(txin.prevout, outPrev, pindexPrev))
+                return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
+                             __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+            splInput->SetPrevout(txin.prevout, outPrev, pindexPrev);
+        }
 
         //verify signature and script
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &serror))
+        if (!VerifyScript(txin.scriptSig, outPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &serror))
             return error("%s : VerifySignature failed on coinstake %s, %s", __func__, tx.GetHash().ToString().c_str(), ScriptErrorString(serror));
-
-        CSplStake* splInput = new CSplStake();
-        splInput->SetInput(txPrev, txin.prevout.n);
-        stake = std::unique_ptr<CStakeInput>(splInput);
     }
     return true;
 }
@@ -59,6 +59,23 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! Write an already serialized key/value pair
+    void WriteRaw(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+    {
+        batch.Put(slKey, slValue);
+    }
+
+    //! Erase an already serialized key
+    void EraseRaw(const leveldb::Slice& slKey)
+    {
+        batch.Delete(slKey);
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
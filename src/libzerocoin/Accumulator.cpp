@@ -11,6 +11,7 @@
  **/
 // Copyright (c) 2017-2019 The PIVX developers
 
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include "Accumulator.h"
@@ -43,7 +44,24 @@ Accumulator::Accumulator(const ZerocoinParams* p, const CoinDenomination d, cons
 
 void Accumulator::increment(const CBigNum& bnValue) {
     // Compute new accumulator = "old accumulator"^{element} mod N
-    this->value = this->value.pow_mod(bnValue, this->params->accumulatorModulus);
+    this->value = CBigNumModExp::Get(this->params->accumulatorModulus)->pow_mod(this->value, bnValue);
+}
+
+void Accumulator::incrementBatch(const std::vector<CBigNum>& vValues) {
+    std::shared_ptr<CBigNumModExp> pExp = CBigNumModExp::Get(this->params->accumulatorModulus);
+    std::vector<CBigNum> vProduct;
+    for (size_t nStart = 0; nStart < vValues.size(); nStart += ACCUMULATOR_BATCH_SIZE) {
+        // multiply the chunk pairwise so that the operands stay balanced
+        size_t nEnd = std::min(nStart + ACCUMULATOR_BATCH_SIZE, vValues.size());
+        vProduct.assign(vValues.begin() + nStart, vValues.begin() + nEnd);
+        while (vProduct.size() > 1) {
+            size_t nHalf = 0;
+            for (size_t i = 0; i < vProduct.size(); i += 2)
+                vProduct[nHalf++] = (i + 1 < vProduct.size()) ? vProduct[i] * vProduct[i + 1] : vProduct[i];
+            vProduct.resize(nHalf);
+        }
+        this->value = pExp->pow_mod(this->value, vProduct[0]);
+    }
 }
 
 void Accumulator::accumulate(const PublicCoin& coin) {
@@ -63,6 +63,15 @@ public:
     void accumulate(const PublicCoin &coin);
     void increment(const CBigNum& bnValue);
 
+    /**
+     * Raise the accumulator to the product of the given values, ACCUMULATOR_BATCH_SIZE
+     * of them at a time. Same result as calling increment() on each value.
+     * No checks performed!
+     *
+     * @param vValues    the coin values to add
+     */
+    void incrementBatch(const std::vector<CBigNum>& vValues);
+
     CoinDenomination getDenomination() const;
     /** Get the accumulator result
      *
@@ -118,14 +118,18 @@ bool AccumulatorProofOfKnowledge:: Verify(const Accumulator& a, const CBigNum& v
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	// Every exponentiation below is under one of two moduli, reuse their Montgomery contexts
+	std::shared_ptr<CBigNumModExp> pPoKExp = CBigNumModExp::Get(params->accumulatorPoKCommitmentGroup.modulus);
+	std::shared_ptr<CBigNumModExp> pAccExp = CBigNumModExp::Get(params->accumulatorModulus);
+
+	CBigNum st_1_prime = (pPoKExp->pow_mod(valueOfCommitmentToCoin, c) * pPoKExp->pow_mod(sg, s_alpha) * pPoKExp->pow_mod(sh, s_phi)) % params->accumulatorPoKCommitmentGroup.modulus;
+	CBigNum st_2_prime = (pPoKExp->pow_mod(sg, c) * pPoKExp->pow_mod(valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus), s_gamma) * pPoKExp->pow_mod(sh, s_psi)) % params->accumulatorPoKCommitmentGroup.modulus;
+	CBigNum st_3_prime = (pPoKExp->pow_mod(sg, c) * pPoKExp->pow_mod(sg * valueOfCommitmentToCoin, s_sigma) * pPoKExp->pow_mod(sh, s_xi)) % params->accumulatorPoKCommitmentGroup.modulus;
+
+	CBigNum t_1_prime = (pAccExp->pow_mod(C_r, c) * pAccExp->pow_mod(h_n, s_zeta) * pAccExp->pow_mod(g_n, s_epsilon)) % params->accumulatorModulus;
+	CBigNum t_2_prime = (pAccExp->pow_mod(C_e, c) * pAccExp->pow_mod(h_n, s_eta) * pAccExp->pow_mod(g_n, s_alpha)) % params->accumulatorModulus;
+	CBigNum t_3_prime = (pAccExp->pow_mod(a.getValue(), c) * pAccExp->pow_mod(C_u, s_alpha) * pAccExp->pow_mod(h_n.inverse(params->accumulatorModulus), s_beta)) % params->accumulatorModulus;
+	CBigNum t_4_prime = (pAccExp->pow_mod(C_r, s_alpha) * pAccExp->pow_mod(h_n.inverse(params->accumulatorModulus), s_delta) * pAccExp->pow_mod(g_n.inverse(params->accumulatorModulus), s_beta)) % params->accumulatorModulus;
 
 	bool result_st1 = (st_1 == st_1_prime);
 	bool result_st2 = (st_2 == st_2_prime);
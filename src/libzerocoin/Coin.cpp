@@ -214,7 +214,7 @@ void PrivateCoin::mintCoinFast(const CoinDenomination denomination) {
 	
 	// Manually compute a Pedersen commitment to the serial number "s" under randomness "r"
 	// C = g^s * h^r mod p
-	CBigNum commitmentValue = this->params->coinCommitmentGroup.g.pow_mod(s, this->params->coinCommitmentGroup.modulus).mul_mod(this->params->coinCommitmentGroup.h.pow_mod(r, this->params->coinCommitmentGroup.modulus), this->params->coinCommitmentGroup.modulus);
+	CBigNum commitmentValue = this->params->coinCommitmentGroup.powG(s).mul_mod(this->params->coinCommitmentGroup.powH(r), this->params->coinCommitmentGroup.modulus);
 	
 	// Repeat this process up to MAX_COINMINT_ATTEMPTS times until
 	// we obtain a prime number
@@ -243,7 +243,7 @@ void PrivateCoin::mintCoinFast(const CoinDenomination denomination) {
 		// r = r + r_delta mod q
 		// C = C * h mod p
 		r = (r + r_delta) % this->params->coinCommitmentGroup.groupOrder;
-		commitmentValue = commitmentValue.mul_mod(this->params->coinCommitmentGroup.h.pow_mod(r_delta, this->params->coinCommitmentGroup.modulus), this->params->coinCommitmentGroup.modulus);
+		commitmentValue = commitmentValue.mul_mod(this->params->coinCommitmentGroup.powH(r_delta), this->params->coinCommitmentGroup.modulus);
 	}
 		
 	// We only get here if we did not find a coin within
@@ -29,6 +29,25 @@ CoinDenomination IntToZerocoinDenomination(int64_t amount)
     return denomination;
 }
 
+int ZerocoinDenominationToIndex(const CoinDenomination& denomination)
+{
+    int nIndex = -1;
+    switch (denomination) {
+    case CoinDenomination::ZQ_ONE: nIndex = 0; break;
+    case CoinDenomination::ZQ_FIVE: nIndex = 1; break;
+    case CoinDenomination::ZQ_TEN: nIndex = 2; break;
+    case CoinDenomination::ZQ_FIFTY: nIndex = 3; break;
+    case CoinDenomination::ZQ_ONE_HUNDRED: nIndex = 4; break;
+    case CoinDenomination::ZQ_FIVE_HUNDRED: nIndex = 5; break;
+    case CoinDenomination::ZQ_ONE_THOUSAND: nIndex = 6; break;
+    case CoinDenomination::ZQ_FIVE_THOUSAND: nIndex = 7; break;
+    default:
+        //not a valid denomination
+        nIndex = -1; break;
+    }
+    return nIndex;
+}
+
 int64_t ZerocoinDenominationToInt(const CoinDenomination& denomination)
 {
     int64_t Value = 0;
@@ -26,6 +26,11 @@ ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	// Generate the parameters
 	CalculateParams(*this, N, ZEROCOIN_PROTOCOL_VERSION, securityLevel);
 
+	// Mints, commitments and serial number proofs raise these generators
+	// over and over; the accumulator PoK group is too large to be worth a table
+	this->coinCommitmentGroup.PrecomputeGenerators();
+	this->serialNumberSoKCommitmentGroup.PrecomputeGenerators();
+
 	this->accumulatorParams.initialized = true;
 	this->initialized = true;
 }
@@ -42,7 +47,24 @@ CBigNum IntegerGroupParams::randomElement() const {
 	// The generator of the group raised
 	// to a random number less than the order of the group
 	// provides us with a uniformly distributed random number.
-	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
+	return powG(CBigNum::randBignum(this->groupOrder));
+}
+
+CBigNum IntegerGroupParams::powG(const CBigNum& e) const {
+	if (pTableG)
+		return pTableG->pow_mod(e);
+	return CBigNumModExp::Get(this->modulus)->pow_mod(this->g, e);
+}
+
+CBigNum IntegerGroupParams::powH(const CBigNum& e) const {
+	if (pTableH)
+		return pTableH->pow_mod(e);
+	return CBigNumModExp::Get(this->modulus)->pow_mod(this->h, e);
+}
+
+void IntegerGroupParams::PrecomputeGenerators() {
+	this->pTableG = std::make_shared<const CBigNumFixedBase>(this->g, this->modulus, this->groupOrder);
+	this->pTableH = std::make_shared<const CBigNumFixedBase>(this->h, this->modulus, this->groupOrder);
 }
 
 } /* namespace libzerocoin */
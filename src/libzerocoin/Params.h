@@ -32,6 +32,17 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Raises g (respectively h) to e mod modulus, from the fixed-base
+	 * table once PrecomputeGenerators() has built it
+	 */
+	CBigNum powG(const CBigNum& e) const;
+	CBigNum powH(const CBigNum& e) const;
+
+	/** Builds the fixed-base exponentiation tables of both generators */
+	void PrecomputeGenerators();
+
 	bool initialized;
 
 	/**
@@ -63,7 +74,15 @@ public:
 		    READWRITE(h);
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
+		    if (ser_action.ForRead()) {
+		        pTableG.reset();
+		        pTableH.reset();
+		    }
 	}	
+
+private:
+	std::shared_ptr<const CBigNumFixedBase> pTableG;
+	std::shared_ptr<const CBigNumFixedBase> pTableH;
 };
 
 class AccumulatorAndProofParams {
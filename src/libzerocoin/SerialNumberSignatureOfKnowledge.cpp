@@ -113,13 +113,14 @@ inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBig
 
     CBigNum a = params->coinCommitmentGroup.g;
     CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
 
-    CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder) *
-            b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+    std::shared_ptr<CBigNumModExp> pOrderExp = CBigNumModExp::Get(params->serialNumberSoKCommitmentGroup.groupOrder);
+
+    CBigNum exponent = (pOrderExp->pow_mod(a, a_exp) *
+            pOrderExp->pow_mod(b, b_exp)) % params->serialNumberSoKCommitmentGroup.groupOrder;
 
-    return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+    return (params->serialNumberSoKCommitmentGroup.powG(exponent) *
+            params->serialNumberSoKCommitmentGroup.powH(h_exp)) % params->serialNumberSoKCommitmentGroup.modulus;
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
@@ -146,6 +147,8 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
 
     std::vector<CBigNum> tprime(params->zkp_iterations);
     unsigned char *hashbytes = (unsigned char*) &this->hash;
+    std::shared_ptr<CBigNumModExp> pOrderExp = CBigNumModExp::Get(params->serialNumberSoKCommitmentGroup.groupOrder);
+    std::shared_ptr<CBigNumModExp> pModExp = CBigNumModExp::Get(params->serialNumberSoKCommitmentGroup.modulus);
 
     try {
         for (uint32_t i = 0; i < params->zkp_iterations; i++) {
@@ -158,11 +161,9 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
                     return error("SoK Verify() :: sprime in pos %d not in valid range", i);
                 tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn);
             } else {
-                CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-                tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus) *
-                             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus)) %
+                CBigNum exp = pOrderExp->pow_mod(b, s_notprime[i]);
+                tprime[i] = (pModExp->pow_mod(valueOfCommitmentToCoin, exp) *
+                             params->serialNumberSoKCommitmentGroup.powH(sprime[i])) %
                             params->serialNumberSoKCommitmentGroup.modulus;
             }
         }
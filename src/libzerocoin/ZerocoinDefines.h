@@ -22,6 +22,7 @@
 #define ACCPROOF_KPRIME                     160
 #define ACCPROOF_KDPRIME                    128
 #define MAX_COINMINT_ATTEMPTS               10000
+#define ACCUMULATOR_BATCH_SIZE              8
 #define ZEROCOIN_MINT_PRIME_PARAM			20
 #define ZEROCOIN_VERSION_STRING             "0.11"
 #define ZEROCOIN_VERSION_INT				11
@@ -6,6 +6,9 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+#include <map>
+
 #if defined(USE_NUM_GMP)
 #include "bignum_gmp.cpp"
 #endif
@@ -14,6 +17,22 @@
 #include "bignum_openssl.cpp"
 #endif
 
+std::shared_ptr<CBigNumModExp> CBigNumModExp::Get(const CBigNum& modulus)
+{
+    // libzerocoin works under a handful of moduli; anything beyond that, such as
+    // parameter generation trying candidates, starts the cache over
+    static thread_local std::map<CBigNum, std::shared_ptr<CBigNumModExp> > mapEngines;
+    std::map<CBigNum, std::shared_ptr<CBigNumModExp> >::iterator it = mapEngines.find(modulus);
+    if (it != mapEngines.end())
+        return it->second;
+
+    if (mapEngines.size() >= MODEXP_MAX_CACHED_MODULI)
+        mapEngines.clear();
+    std::shared_ptr<CBigNumModExp> engine = std::make_shared<CBigNumModExp>(modulus);
+    mapEngines.insert(std::make_pair(modulus, engine));
+    return engine;
+}
+
 std::string CBigNum::GetHex() const
 {
     return ToString(16);
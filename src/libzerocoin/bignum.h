@@ -18,6 +18,7 @@
 #include <gmp.h>
 #endif
 
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <limits.h>
@@ -208,6 +209,98 @@ public:
     friend inline bool operator>=(const CBigNum& a, const CBigNum& b);
     friend inline bool operator<(const CBigNum& a, const CBigNum& b);
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
+    friend class CBigNumModExp;
+    friend class CBigNumFixedBase;
+};
+
+/** Number of moduli each thread keeps an exponentiation engine for */
+static const unsigned int MODEXP_MAX_CACHED_MODULI = 16;
+
+/** Exponent bits covered by one row of a CBigNumFixedBase table */
+static const unsigned int FIXEDBASE_WINDOW_BITS = 4;
+
+/**
+ * Modular exponentiation under one fixed modulus. The OpenSSL backend keeps the
+ * Montgomery form of an odd modulus and a BN_CTX for the lifetime of the engine,
+ * the GMP backend keeps the scratch space of mpn_sec_powm. Results are the same
+ * as CBigNum::pow_mod. An engine must not be shared between threads, Get()
+ * returns one owned by the calling thread.
+ */
+class CBigNumModExp
+{
+public:
+    explicit CBigNumModExp(const CBigNum& modulusIn);
+    ~CBigNumModExp();
+
+    /**
+     * modular exponentiation: base^e mod modulus
+     * @param base the base
+     * @param e exponent, a negative one raises the inverse of base
+     */
+    CBigNum pow_mod(const CBigNum& base, const CBigNum& e);
+
+    const CBigNum& getModulus() const { return modulus; }
+
+    /** Engine for the modulus owned by the calling thread, created on first use */
+    static std::shared_ptr<CBigNumModExp> Get(const CBigNum& modulus);
+
+private:
+    CBigNum modulus;
+#if defined(USE_NUM_OPENSSL)
+    BN_CTX* pctx;
+    BN_MONT_CTX* pmont;
+#endif
+#if defined(USE_NUM_GMP)
+    std::vector<mp_limb_t> vScratch;
+#endif
+
+    CBigNumModExp(const CBigNumModExp&);
+    CBigNumModExp& operator=(const CBigNumModExp&);
+};
+
+/**
+ * Exponentiation of one fixed base under a fixed modulus from a precomputed
+ * table holding base^(d * 2^(FIXEDBASE_WINDOW_BITS * i)) for every digit d and
+ * window i of an exponent as long as the group order. Raising the base then
+ * takes one table multiplication per exponent window and no squarings.
+ * Exponents are reduced modulo the order, so the base must generate a subgroup
+ * of that order. The table is read-only once built and may be shared between
+ * threads. The GMP backend selects table entries and reduces in constant time,
+ * like CBigNum::pow_mod.
+ */
+class CBigNumFixedBase
+{
+public:
+    CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, const CBigNum& orderIn);
+    ~CBigNumFixedBase();
+
+    /**
+     * modular exponentiation: base^e mod modulus
+     * @param e exponent, reduced modulo the order first if negative or too long
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+
+    const CBigNum& getBase() const { return base; }
+    const CBigNum& getModulus() const { return modulus; }
+
+private:
+    CBigNum base;
+    CBigNum modulus;
+    CBigNum order;
+    unsigned int nWindows;
+#if defined(USE_NUM_OPENSSL)
+    //! Montgomery form of each entry, nWindows rows of 2^FIXEDBASE_WINDOW_BITS
+    std::vector<CBigNum> vTable;
+    BN_MONT_CTX* pmont;
+#endif
+#if defined(USE_NUM_GMP)
+    //! Limbs of each entry padded to the modulus size, nWindows rows of 2^FIXEDBASE_WINDOW_BITS
+    std::vector<mp_limb_t> vTable;
+    mp_size_t nLimbs;
+#endif
+
+    CBigNumFixedBase(const CBigNumFixedBase&);
+    CBigNumFixedBase& operator=(const CBigNumFixedBase&);
 };
 
 #if defined(USE_NUM_OPENSSL)
@@ -245,6 +245,103 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+CBigNumModExp::CBigNumModExp(const CBigNum& modulusIn) : modulus(modulusIn)
+{
+}
+
+CBigNumModExp::~CBigNumModExp()
+{
+}
+
+CBigNum CBigNumModExp::pow_mod(const CBigNum& base, const CBigNum& e)
+{
+    // same choice as CBigNum::pow_mod: side-channel silent for positive exponents and odd moduli
+    if (!(e > CBigNum(0)) || !mpz_odd_p(modulus.bn))
+        return base.pow_mod(e, modulus);
+
+    // mpn_sec_powm wants a positive base, reduced or not
+    CBigNum bnBase;
+    mpz_mod(bnBase.bn, base.bn, modulus.bn);
+    if (mpz_sgn(bnBase.bn) == 0)
+        return bnBase;
+
+    mp_size_t nBase = mpz_size(bnBase.bn);
+    mp_size_t n = mpz_size(modulus.bn);
+    mp_bitcnt_t nExpBits = mpz_sizeinbase(e.bn, 2);
+    mp_size_t nScratch = mpn_sec_powm_itch(nBase, nExpBits, n);
+    if (vScratch.size() < (size_t)nScratch)
+        vScratch.resize(nScratch);
+
+    CBigNum ret;
+    mp_limb_t* rp = mpz_limbs_write(ret.bn, n);
+    mpn_sec_powm(rp, mpz_limbs_read(bnBase.bn), nBase, mpz_limbs_read(e.bn), nExpBits,
+                 mpz_limbs_read(modulus.bn), n, vScratch.data());
+    mpz_limbs_finish(ret.bn, n);
+    return ret;
+}
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, const CBigNum& orderIn) : base(baseIn), modulus(modulusIn), order(orderIn)
+{
+    if (!mpz_odd_p(modulus.bn) || mpz_sgn(order.bn) <= 0)
+        throw bignum_error("CBigNumFixedBase : modulus must be odd and order positive");
+
+    const size_t nDigits = 1 << FIXEDBASE_WINDOW_BITS;
+    nWindows = (mpz_sizeinbase(order.bn, 2) + FIXEDBASE_WINDOW_BITS - 1) / FIXEDBASE_WINDOW_BITS;
+    nLimbs = mpz_size(modulus.bn);
+    vTable.assign(nWindows * nDigits * nLimbs, 0);
+
+    // row i holds powers of base^(2^(w*i)); its last entry times that base starts the next row
+    CBigNum bnRow, bnEntry;
+    mpz_mod(bnRow.bn, base.bn, modulus.bn);
+    for (unsigned int i = 0; i < nWindows; i++) {
+        mpz_set_ui(bnEntry.bn, 1);
+        for (size_t d = 0; d < nDigits; d++) {
+            mp_limb_t* pEntry = &vTable[(i * nDigits + d) * nLimbs];
+            for (size_t k = 0; k < mpz_size(bnEntry.bn); k++)
+                pEntry[k] = mpz_getlimbn(bnEntry.bn, k);
+            mpz_mul(bnEntry.bn, bnEntry.bn, bnRow.bn);
+            mpz_mod(bnEntry.bn, bnEntry.bn, modulus.bn);
+        }
+        mpz_swap(bnRow.bn, bnEntry.bn);
+    }
+}
+
+CBigNumFixedBase::~CBigNumFixedBase()
+{
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    CBigNum bnExp(e);
+    if (mpz_sgn(e.bn) < 0 || mpz_sizeinbase(e.bn, 2) > nWindows * FIXEDBASE_WINDOW_BITS)
+        mpz_mod(bnExp.bn, e.bn, order.bn);
+
+    // every window is read and every entry of its row touched, whatever the exponent
+    const size_t nDigits = 1 << FIXEDBASE_WINDOW_BITS;
+    std::vector<mp_limb_t> vExp((nWindows * FIXEDBASE_WINDOW_BITS + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS, 0);
+    for (size_t k = 0; k < mpz_size(bnExp.bn); k++)
+        vExp[k] = mpz_getlimbn(bnExp.bn, k);
+
+    std::vector<mp_limb_t> vResult(nLimbs, 0), vEntry(nLimbs), vProduct(2 * nLimbs);
+    std::vector<mp_limb_t> vScratch(std::max(mpn_sec_mul_itch(nLimbs, nLimbs), mpn_sec_div_r_itch(2 * nLimbs, nLimbs)));
+    const mp_limb_t* pModulus = mpz_limbs_read(modulus.bn);
+    vResult[0] = 1;
+    for (unsigned int i = 0; i < nWindows; i++) {
+        unsigned int nBit = i * FIXEDBASE_WINDOW_BITS;
+        mp_size_t nDigit = (vExp[nBit / GMP_NUMB_BITS] >> (nBit % GMP_NUMB_BITS)) & (nDigits - 1);
+        mpn_sec_tabselect(vEntry.data(), &vTable[i * nDigits * nLimbs], nLimbs, nDigits, nDigit);
+        mpn_sec_mul(vProduct.data(), vResult.data(), nLimbs, vEntry.data(), nLimbs, vScratch.data());
+        mpn_sec_div_r(vProduct.data(), 2 * nLimbs, pModulus, nLimbs, vScratch.data());
+        std::copy(vProduct.begin(), vProduct.begin() + nLimbs, vResult.begin());
+    }
+
+    CBigNum ret;
+    mp_limb_t* rp = mpz_limbs_write(ret.bn, nLimbs);
+    std::copy(vResult.begin(), vResult.end(), rp);
+    mpz_limbs_finish(ret.bn, nLimbs);
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
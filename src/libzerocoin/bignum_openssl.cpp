@@ -373,6 +373,111 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+CBigNumModExp::CBigNumModExp(const CBigNum& modulusIn) : modulus(modulusIn), pctx(NULL), pmont(NULL)
+{
+    pctx = BN_CTX_new();
+    if (pctx == NULL)
+        throw bignum_error("CBigNumModExp : BN_CTX_new() returned NULL");
+    // Montgomery multiplication needs an odd modulus, BN_mod_exp handles the others
+    if (BN_is_odd(modulus.bn)) {
+        pmont = BN_MONT_CTX_new();
+        if (pmont == NULL || !BN_MONT_CTX_set(pmont, modulus.bn, pctx)) {
+            BN_MONT_CTX_free(pmont);
+            BN_CTX_free(pctx);
+            throw bignum_error("CBigNumModExp : BN_MONT_CTX_set failed");
+        }
+    }
+}
+
+CBigNumModExp::~CBigNumModExp()
+{
+    if (pmont != NULL)
+        BN_MONT_CTX_free(pmont);
+    BN_CTX_free(pctx);
+}
+
+CBigNum CBigNumModExp::pow_mod(const CBigNum& base, const CBigNum& e)
+{
+    if (e < 0) {
+        // g^-x = (g^-1)^x
+        return pow_mod(base.inverse(modulus), e * -1);
+    }
+
+    CBigNum ret;
+    if (pmont != NULL) {
+        if (!BN_mod_exp_mont(ret.bn, base.bn, e.bn, modulus.bn, pctx, pmont))
+            throw bignum_error("CBigNumModExp::pow_mod : BN_mod_exp_mont failed");
+    } else if (!BN_mod_exp(ret.bn, base.bn, e.bn, modulus.bn, pctx)) {
+        throw bignum_error("CBigNumModExp::pow_mod : BN_mod_exp failed");
+    }
+
+    return ret;
+}
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, const CBigNum& orderIn) : base(baseIn), modulus(modulusIn), order(orderIn), pmont(NULL)
+{
+    if (!BN_is_odd(modulus.bn) || BN_is_negative(order.bn) || BN_is_zero(order.bn))
+        throw bignum_error("CBigNumFixedBase : modulus must be odd and order positive");
+
+    CAutoBN_CTX pctx;
+    pmont = BN_MONT_CTX_new();
+    if (pmont == NULL || !BN_MONT_CTX_set(pmont, modulus.bn, pctx)) {
+        BN_MONT_CTX_free(pmont);
+        throw bignum_error("CBigNumFixedBase : BN_MONT_CTX_set failed");
+    }
+
+    const size_t nDigits = 1 << FIXEDBASE_WINDOW_BITS;
+    nWindows = (BN_num_bits(order.bn) + FIXEDBASE_WINDOW_BITS - 1) / FIXEDBASE_WINDOW_BITS;
+    vTable.resize(nWindows * nDigits);
+
+    // row i holds powers of base^(2^(w*i)); its last entry times that base starts the next row
+    CBigNum bnRow, bnEntry;
+    if (!BN_nnmod(bnRow.bn, base.bn, modulus.bn, pctx) ||
+        !BN_to_montgomery(bnRow.bn, bnRow.bn, pmont, pctx))
+        throw bignum_error("CBigNumFixedBase : BN_to_montgomery failed");
+    for (unsigned int i = 0; i < nWindows; i++) {
+        if (!BN_to_montgomery(bnEntry.bn, BN_value_one(), pmont, pctx))
+            throw bignum_error("CBigNumFixedBase : BN_to_montgomery failed");
+        for (size_t d = 0; d < nDigits; d++) {
+            vTable[i * nDigits + d] = bnEntry;
+            if (!BN_mod_mul_montgomery(bnEntry.bn, bnEntry.bn, bnRow.bn, pmont, pctx))
+                throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+        }
+        bnRow = bnEntry;
+    }
+}
+
+CBigNumFixedBase::~CBigNumFixedBase()
+{
+    BN_MONT_CTX_free(pmont);
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    CAutoBN_CTX pctx;
+    CBigNum bnExp(e);
+    if (BN_is_negative(e.bn) || (unsigned int)BN_num_bits(e.bn) > nWindows * FIXEDBASE_WINDOW_BITS) {
+        if (!BN_nnmod(bnExp.bn, e.bn, order.bn, pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod : BN_nnmod failed");
+    }
+
+    const size_t nDigits = 1 << FIXEDBASE_WINDOW_BITS;
+    CBigNum ret = vTable[0];
+    for (unsigned int i = 0; i < nWindows; i++) {
+        size_t nDigit = 0;
+        for (unsigned int b = 0; b < FIXEDBASE_WINDOW_BITS; b++) {
+            if (BN_is_bit_set(bnExp.bn, i * FIXEDBASE_WINDOW_BITS + b))
+                nDigit |= (size_t)1 << b;
+        }
+        if (nDigit != 0 && !BN_mod_mul_montgomery(ret.bn, ret.bn, vTable[i * nDigits + nDigit].bn, pmont, pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod : BN_mod_mul_montgomery failed");
+    }
+    if (!BN_from_montgomery(ret.bn, ret.bn, pmont, pctx))
+        throw bignum_error("CBigNumFixedBase::pow_mod : BN_from_montgomery failed");
+
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
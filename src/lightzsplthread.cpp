@@ -5,112 +5,297 @@
 
 
 #include "lightzsplthread.h"
+#include "hash.h"
 #include "main.h"
 
+bool CLightWorker::addWitWork(CGenWit wit) {
+    if (!isWorkerRunning) {
+        LogPrintf("%s not running trying to add wit work \n", "simplicity-light-thread");
+        return false;
+    }
+    CNode* pfrom = wit.getPfrom();
+    if (!pfrom)
+        return false;
+
+    const NodeId nodeId = pfrom->GetId();
+    const uint256 hashKey = getWorkKey(wit);
+    const int64_t nNow = GetTime();
+    {
+        LOCK(cs_vNodes);
+        pfrom->AddRef();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (fShutdown) {
+            lock.unlock();
+            releasePeer(wit);
+            return false;
+        }
+
+        // Refill the budgets and forget idle peers whose budget is full again
+        for (std::map<NodeId, CPeerBudget>::iterator it = mapPeerBudgets.begin(); it != mapPeerBudgets.end();) {
+            CPeerBudget& budget = it->second;
+            budget.dTokens = std::min((double)MAX_LIGHT_WORK_PER_PEER, budget.dTokens + (nNow - budget.nLastTime) * LIGHT_WORK_PEER_RATE / 60.0);
+            budget.nLastTime = nNow;
+            if (it->first != nodeId && budget.dTokens >= MAX_LIGHT_WORK_PER_PEER && !mapPeerQueues.count(it->first))
+                it = mapPeerBudgets.erase(it);
+            else
+                ++it;
+        }
+        std::map<NodeId, CPeerBudget>::iterator itBudget = mapPeerBudgets.find(nodeId);
+        if (itBudget == mapPeerBudgets.end()) {
+            CPeerBudget budget;
+            budget.dTokens = MAX_LIGHT_WORK_PER_PEER;
+            budget.nLastTime = nNow;
+            itBudget = mapPeerBudgets.insert(std::make_pair(nodeId, budget)).first;
+        }
+
+        bool fAccept = itBudget->second.dTokens >= 1;
+        if (!fAccept) {
+            LogPrint("zspl", "%s : peer=%d over its witness request rate\n", __func__, nodeId);
+        } else if (mapInFlight.count(hashKey)) {
+            // The same witness is being computed already, answer this request with it
+            mapInFlight[hashKey].push_back(wit);
+        } else {
+            std::map<NodeId, std::deque<std::pair<uint256, CGenWit>>>::iterator itQueue = mapPeerQueues.find(nodeId);
+            size_t nPeerQueued = itQueue == mapPeerQueues.end() ? 0 : itQueue->second.size();
+            fAccept = nQueued < MAX_LIGHT_WORK_QUEUE && nPeerQueued < MAX_LIGHT_WORK_PER_PEER;
+            if (!fAccept) {
+                LogPrint("zspl", "%s : witness queue full for peer=%d (%u queued)\n", __func__, nodeId, nQueued);
+            } else {
+                if (nPeerQueued == 0)
+                    dequePeers.push_back(nodeId);
+                mapPeerQueues[nodeId].push_back(std::make_pair(hashKey, wit));
+                nQueued++;
+            }
+        }
+        if (fAccept)
+            itBudget->second.dTokens -= 1;
+        else {
+            lock.unlock();
+            releasePeer(wit);
+            return false;
+        }
+    }
+    condition.notify_one();
+    return true;
+}
+
+void CLightWorker::StartLightZsplThread(boost::thread_group& threadGroup) {
+    int nThreads = GetArg("-lightzsplthreads", DEFAULT_LIGHT_ZSPL_THREADS);
+    nThreads = std::max(1, std::min(nThreads, MAX_LIGHT_ZSPL_THREADS));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fShutdown = false;
+    }
+    LogPrintf("%s starting %d threads\n", "simplicity-light-thread", nThreads);
+    for (int i = 0; i < nThreads; i++)
+        threadGroupWorkers.create_thread(boost::bind(&CLightWorker::ThreadLightZSPLSimplified, this));
+    isWorkerRunning = true;
+}
+
+void CLightWorker::StopLightZsplThread() {
+    isWorkerRunning = false;
+    std::vector<CGenWit> vPending;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fShutdown = true;
+        for (std::map<NodeId, std::deque<std::pair<uint256, CGenWit>>>::value_type& item : mapPeerQueues) {
+            for (std::pair<uint256, CGenWit>& work : item.second)
+                vPending.push_back(work.second);
+        }
+        mapPeerQueues.clear();
+        dequePeers.clear();
+        nQueued = 0;
+    }
+    condition.notify_all();
+    threadGroupWorkers.interrupt_all();
+    threadGroupWorkers.join_all();
+    for (CGenWit& wit : vPending)
+        releasePeer(wit);
+    LogPrintf("%s threads stopped\n", "simplicity-light-thread");
+}
+
 /****** Thread ********/
 void CLightWorker::ThreadLightZSPLSimplified() {
     RenameThread("simplicity-light-thread");
-    isWorkerRunning = true;
     while (true) {
         try {
+            CWitJob job;
+            if (!popWork(job))
+                break;
+            processWork(job);
+        } catch (const boost::thread_interrupted&) {
+            break;
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "lightzsplthread");
+        }
+    }
+}
 
-            // Take a breath between requests.. TODO: Add processor usage check here
-            MilliSleep(2000);
+bool CLightWorker::popWork(CWitJob& job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]{ return fShutdown || !dequePeers.empty(); });
+    if (fShutdown)
+        return false;
 
-            // TODO: Future: join several similar requests into one calculation if the filter and denom match..
-            CGenWit genWit = requestsQueue.pop();
-            LogPrintf("%s pop work for %s \n\n", "simplicity-light-thread", genWit.toString());
+    // Serve the peers in turn, each of them in the order it sent its requests
+    NodeId nodeId = dequePeers.front();
+    dequePeers.pop_front();
+    std::deque<std::pair<uint256, CGenWit>>& queue = mapPeerQueues[nodeId];
+    job.hashKey = queue.front().first;
+    job.vRequests.assign(1, queue.front().second);
+    queue.pop_front();
+    nQueued--;
+    if (queue.empty())
+        mapPeerQueues.erase(nodeId);
+    else
+        dequePeers.push_back(nodeId);
 
-            libzerocoin::ZerocoinParams *params = Params().Zerocoin_Params(false);
-            CBlockIndex *pIndex = chainActive[genWit.getStartingHeight()];
-            if (!pIndex) {
-                // Rejects only the failed height
-                rejectWork(genWit, genWit.getStartingHeight(), NON_DETERMINED);
+    // Take every waiting request for the same witness along
+    for (std::map<NodeId, std::deque<std::pair<uint256, CGenWit>>>::iterator it = mapPeerQueues.begin(); it != mapPeerQueues.end();) {
+        std::deque<std::pair<uint256, CGenWit>>& queuePeer = it->second;
+        for (std::deque<std::pair<uint256, CGenWit>>::iterator itWit = queuePeer.begin(); itWit != queuePeer.end();) {
+            if (itWit->first == job.hashKey) {
+                job.vRequests.push_back(itWit->second);
+                itWit = queuePeer.erase(itWit);
+                nQueued--;
             } else {
-                LogPrintf("%s calculating work for %s \n\n", "simplicity-light-thread", genWit.toString());
-                int blockHeight = pIndex->nHeight;
-                if (blockHeight >= Params().Zerocoin_Block_V2_Start()) {
-
-                    // TODO: The protocol actually doesn't care about the Accumulator..
-                    libzerocoin::Accumulator accumulator(params, genWit.getDen(), genWit.getAccWitValue());
-                    libzerocoin::PublicCoin temp(params);
-                    libzerocoin::AccumulatorWitness witness(params, accumulator, temp);
-                    std::string strFailReason = "";
-                    int nMintsAdded = 0;
-                    CZerocoinSpendReceipt receipt;
-
-                    std::list<CBigNum> ret;
-                    int heightStop;
-
-                    bool res;
-                    try {
-
-                        res = CalculateAccumulatorWitnessFor(
-                                params,
-                                blockHeight,
-                                COMP_MAX_AMOUNT,
-                                genWit.getDen(),
-                                genWit.getFilter(),
-                                accumulator,
-                                witness,
-                                nMintsAdded,
-                                strFailReason,
-                                ret,
-                                heightStop
-                        );
-
-                    } catch (NotEnoughMintsException e) {
-                        LogPrintStr(std::string("ThreadLightZSPLSimplified: ") + e.message + "\n");
-                        rejectWork(genWit, blockHeight, NOT_ENOUGH_MINTS);
-                        continue;
-                    }
-
-                    if (!res) {
-                        // TODO: Check if the GenerateAccumulatorWitnessFor can fail for node's fault or it's just because the peer sent an illegal request..
-                        rejectWork(genWit, blockHeight, NON_DETERMINED);
-                    } else {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(ret.size() * 32);
-
-                        ss << genWit.getRequestNum();
-                        ss << accumulator.getValue(); // TODO: ---> this accumulator value is not necessary. The light node should get it using the other message..
-                        ss << witness.getValue();
-                        uint32_t size = ret.size();
-                        ss << size;
-                        for (CBigNum bnValue : ret) {
-                            ss << bnValue;
-                        }
-                        ss << heightStop;
-                        if (genWit.getPfrom()) {
-                            LogPrintf("%s pushing message to %s \n", "simplicity-light-thread", genWit.getPfrom()->addrName);
-                            genWit.getPfrom()->PushMessage("pubcoins", ss);
-                        } else
-                            LogPrintf("%s NOT pushing message to %s \n", "simplicity-light-thread", genWit.getPfrom()->addrName);
-                    }
-                } else {
-                    // Rejects only the failed height
-                    rejectWork(genWit, blockHeight, NON_DETERMINED);
+                ++itWit;
+            }
+        }
+        if (queuePeer.empty()) {
+            dequePeers.erase(std::find(dequePeers.begin(), dequePeers.end(), it->first));
+            it = mapPeerQueues.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    mapInFlight[job.hashKey];
+    return true;
+}
+
+void CLightWorker::processWork(CWitJob& job) {
+    const CGenWit& genWit = job.vRequests.front();
+    LogPrintf("%s pop work for %s (%u requests)\n\n", "simplicity-light-thread", genWit.toString(), job.vRequests.size());
+
+    bool fResult = false;
+    bool fInterrupted = false;
+    uint32_t errorNumber = NON_DETERMINED;
+    CDataStream ssResult(SER_NETWORK, PROTOCOL_VERSION);
+
+    // Anything thrown here is caught, so that the requests are always answered and their peers released
+    try {
+        libzerocoin::ZerocoinParams *params = Params().Zerocoin_Params(false);
+        CBlockIndex *pIndex = chainActive[genWit.getStartingHeight()];
+        if (pIndex && pIndex->nHeight >= Params().Zerocoin_Block_V2_Start()) {
+            LogPrintf("%s calculating work for %s \n\n", "simplicity-light-thread", genWit.toString());
+            int blockHeight = pIndex->nHeight;
+
+            // TODO: The protocol actually doesn't care about the Accumulator..
+            libzerocoin::Accumulator accumulator(params, genWit.getDen(), genWit.getAccWitValue());
+            libzerocoin::PublicCoin temp(params);
+            libzerocoin::AccumulatorWitness witness(params, accumulator, temp);
+            std::string strFailReason = "";
+            int nMintsAdded = 0;
+
+            std::list<CBigNum> ret;
+            int heightStop;
+
+            fResult = CalculateAccumulatorWitnessFor(
+                    params,
+                    blockHeight,
+                    COMP_MAX_AMOUNT,
+                    genWit.getDen(),
+                    genWit.getFilter(),
+                    accumulator,
+                    witness,
+                    nMintsAdded,
+                    strFailReason,
+                    ret,
+                    heightStop,
+                    &rangeCache
+            );
+
+            if (fResult) {
+                ssResult.reserve(ret.size() * 32);
+                ssResult << accumulator.getValue(); // TODO: ---> this accumulator value is not necessary. The light node should get it using the other message..
+                ssResult << witness.getValue();
+                uint32_t size = ret.size();
+                ssResult << size;
+                for (const CBigNum& bnValue : ret) {
+                    ssResult << bnValue;
                 }
+                ssResult << heightStop;
+            }
+        }
+    } catch (NotEnoughMintsException& e) {
+        LogPrintStr(std::string("ThreadLightZSPLSimplified: ") + e.message + "\n");
+        fResult = false;
+        errorNumber = NOT_ENOUGH_MINTS;
+    } catch (const boost::thread_interrupted&) {
+        fResult = false;
+        fInterrupted = true;
+    } catch (std::exception& e) {
+        fResult = false;
+        PrintExceptionContinue(&e, "lightzsplthread");
+    } catch (...) {
+        fResult = false;
+        PrintExceptionContinue(NULL, "lightzsplthread");
+    }
+
+    // Requests that arrived during the computation get the same answer
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::map<uint256, std::vector<CGenWit>>::iterator it = mapInFlight.find(job.hashKey);
+        if (it != mapInFlight.end()) {
+            job.vRequests.insert(job.vRequests.end(), it->second.begin(), it->second.end());
+            mapInFlight.erase(it);
+        }
+    }
+
+    for (CGenWit& wit : job.vRequests) {
+        try {
+            if (fInterrupted) {
+                // Shutting down, the peers are not answered
+            } else if (!fResult) {
+                rejectWork(wit, errorNumber);
+            } else if (!wit.getPfrom()->fDisconnect) {
+                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                ss << wit.getRequestNum();
+                ss += ssResult;
+                LogPrintf("%s pushing message to %s \n", "simplicity-light-thread", wit.getPfrom()->addrName);
+                wit.getPfrom()->PushMessage("pubcoins", ss);
             }
         } catch (std::exception& e) {
-            //std::cout << "exception in light loop, closing it. " << e.what() << std::endl;
             PrintExceptionContinue(&e, "lightzsplthread");
-            break;
         }
+        releasePeer(wit);
     }
 
-
+    if (fInterrupted)
+        throw boost::thread_interrupted();
 }
 
 // TODO: Think more the peer misbehaving policy..
-void CLightWorker::rejectWork(CGenWit& wit, int blockHeight, uint32_t errorNumber) {
-    if (wit.getStartingHeight() == blockHeight){
-        LogPrintf("%s rejecting work %s , error code: %s\n", "simplicity-light-thread", wit.toString(), errorNumber);
-        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-        ss << wit.getRequestNum();
-        ss << errorNumber;
-        wit.getPfrom()->PushMessage("pubcoins", ss);
-    } else {
-        requestsQueue.push(wit);
-    }
+void CLightWorker::rejectWork(CGenWit& wit, uint32_t errorNumber) {
+    if (wit.getPfrom()->fDisconnect)
+        return;
+    LogPrintf("%s rejecting work %s , error code: %s\n", "simplicity-light-thread", wit.toString(), errorNumber);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << wit.getRequestNum();
+    ss << errorNumber;
+    wit.getPfrom()->PushMessage("pubcoins", ss);
+}
+
+uint256 CLightWorker::getWorkKey(const CGenWit& wit) {
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << wit.getDen() << wit.getStartingHeight() << wit.getFilter() << wit.getAccWitValue();
+    return ss.GetHash();
+}
+
+void CLightWorker::releasePeer(CGenWit& wit) {
+    LOCK(cs_vNodes);
+    wit.getPfrom()->Release();
 }
@@ -7,10 +7,15 @@
 #define SIMPLICITY_LIGHTZSPLTHREAD_H
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
 #include "genwit.h"
 #include "zspl/accumulators.h"
-#include "concurrentqueue.h"
 #include "chainparams.h"
+#include "net.h"
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
 
@@ -18,20 +23,59 @@ extern CChain chainActive;
 // Max amount of computation for a single request
 const int COMP_MAX_AMOUNT = 60 * 24 * 60;
 
+/** Default and maximum number of threads computing light client witnesses */
+static const int DEFAULT_LIGHT_ZSPL_THREADS = 2;
+static const int MAX_LIGHT_ZSPL_THREADS = 8;
+/** Maximum number of witness requests waiting, over all peers */
+static const size_t MAX_LIGHT_WORK_QUEUE = 1000;
+/** Maximum number of witness requests waiting from a single peer, also its burst allowance */
+static const size_t MAX_LIGHT_WORK_PER_PEER = 10;
+/** Number of witness requests a peer may make per minute once its burst is spent */
+static const int LIGHT_WORK_PEER_RATE = 6;
+
 
 /****** Thread ********/
 
+/**
+ * Computes accumulator witnesses for light clients on a small pool of threads.
+ * Every peer has its own FIFO queue and the queues are served in turn, so a
+ * busy peer cannot starve the others. Requests that only differ in their
+ * request number (same denomination, starting height, filter and witness)
+ * are answered by a single computation.
+ */
 class CLightWorker{
 
 private:
 
-    concurrentqueue<CGenWit> requestsQueue;
+    struct CPeerBudget {
+        double dTokens;
+        int64_t nLastTime;
+    };
+
+    struct CWitJob {
+        uint256 hashKey;
+        std::vector<CGenWit> vRequests;
+    };
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    //! Pending requests of each peer with their work key, oldest first
+    std::map<NodeId, std::deque<std::pair<uint256, CGenWit>>> mapPeerQueues;
+    //! Peers with pending requests in the order they are served
+    std::deque<NodeId> dequePeers;
+    std::map<NodeId, CPeerBudget> mapPeerBudgets;
+    //! Requests attached to a computation that is already running
+    std::map<uint256, std::vector<CGenWit>> mapInFlight;
+    size_t nQueued;
+    bool fShutdown;
+
     std::atomic<bool> isWorkerRunning;
-    boost::thread threadIns;
+    boost::thread_group threadGroupWorkers;
+    CAccumulatorRangeCache rangeCache;
 
 public:
 
-    CLightWorker() {
+    CLightWorker() : nQueued(0), fShutdown(false) {
         isWorkerRunning = false;
     }
 
@@ -40,30 +84,27 @@ public:
         NON_DETERMINED = 1
     };
 
-    bool addWitWork(CGenWit wit) {
-        if (!isWorkerRunning) {
-            LogPrintf("%s not running trying to add wit work \n", "simplicity-light-thread");
-            return false;
-        }
-        requestsQueue.push(wit);
-        return true;
-    }
+    //! Queue a request; false when the server is not running, full or the peer is over its rate
+    bool addWitWork(CGenWit wit);
 
-    void StartLightZsplThread(boost::thread_group& threadGroup) {
-        LogPrintf("%s thread start\n", "simplicity-light-thread");
-        threadIns = boost::thread(boost::bind(&CLightWorker::ThreadLightZSPLSimplified, this));
-    }
+    void StartLightZsplThread(boost::thread_group& threadGroup);
 
-    void StopLightZsplThread() {
-        threadIns.interrupt();
-        LogPrintf("%s thread interrupted\n", "simplicity-light-thread");
-    }
+    void StopLightZsplThread();
 
 private:
 
     void ThreadLightZSPLSimplified();
 
-    void rejectWork(CGenWit& wit, int blockHeight, uint32_t errorNumber);
+    //! Wait for the next job; false on shutdown
+    bool popWork(CWitJob& job);
+
+    void processWork(CWitJob& job);
+
+    void rejectWork(CGenWit& wit, uint32_t errorNumber);
+
+    static uint256 getWorkKey(const CGenWit& wit);
+
+    static void releasePeer(CGenWit& wit);
 
 };
 
@@ -17,6 +17,8 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -25,6 +27,7 @@
 #include "merkleblock.h"
 #include "net.h"
 #include "obfuscation.h"
+#include "orderedpipeline.h"
 #include "pow.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -66,17 +69,23 @@ BlockMap mapBlockIndex;
 std::map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
+CBlockIndex* pindexSnapshotBase = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPoWCheckThreads = 0;
+int nPrefetchThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 bool fClearSpendCache = false;
 
@@ -155,6 +164,11 @@ namespace {
     CCriticalSection cs_LastBlockFile;
     std::vector<CBlockFileInfo> vinfoBlockFile;
     int nLastBlockFile = 0;
+    /** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+    bool fCheckForPruning = false;
+
+    /** Storage of all entries in mapBlockIndex. */
+    CBlockIndexArena blockIndexArena;
 
     /**
      * Every received block is assigned a unique and increasing identifier, so we
@@ -209,6 +223,13 @@ namespace {
     /** Dirty block index entries. */
     std::set<CBlockIndex*> setDirtyBlockIndex;
 
+    /**
+     * Verified scrypt² PoW hashes of headers that have no block index entry
+     * yet, keyed by block hash. Moved into the index by AddToBlockIndex.
+     * Protected by cs_main.
+     */
+    limitedmap<uint256, uint256> mapPendingPoWHashes(MAX_PENDING_POW_HASHES);
+
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
 
@@ -651,6 +672,30 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     }
 }
 
+/** Lowest block below the base of a UTXO snapshot whose data may still be missing */
+int nSnapshotDownloadHeight = 1;
+
+/** Add not-in-flight blocks below the base of a UTXO snapshot that the peer has to vBlocks, lowest
+ *  first, until it has at most count entries. They are downloaded for the snapshot validation. */
+void FindSnapshotBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks) {
+    if (pindexSnapshotBase == NULL || vBlocks.size() >= count)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    if (state->pindexBestKnownBlock == NULL || state->pindexBestKnownBlock->GetAncestor(pindexSnapshotBase->nHeight) != pindexSnapshotBase)
+        return;
+
+    while (nSnapshotDownloadHeight < pindexSnapshotBase->nHeight && (chainActive[nSnapshotDownloadHeight]->nStatus & BLOCK_HAVE_DATA))
+        nSnapshotDownloadHeight++;
+    int nWindowEnd = std::min(nSnapshotDownloadHeight + (int)BLOCK_DOWNLOAD_WINDOW, pindexSnapshotBase->nHeight);
+    for (int nHeight = nSnapshotDownloadHeight; nHeight <= nWindowEnd && vBlocks.size() < count; nHeight++) {
+        CBlockIndex* pindex = chainActive[nHeight];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0)
+            vBlocks.push_back(pindex);
+    }
+}
+
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
@@ -704,6 +749,8 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
+CCoinsViewFlusher* pcoinsflusher = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -1036,20 +1083,24 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, int nBestHei
     for (const CTxIn& txin : tx.vin) {
         // First try finding the previous transaction in database
         CTransaction txPrev;
+        CTxOut outPrev;
         uint256 hashBlockPrev;
-        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlockPrev, true)) {
+        if (GetTransaction(txin.prevout.hash, txPrev, hashBlockPrev, true) && txin.prevout.n < txPrev.vout.size()) {
+            BlockMap::iterator it = mapBlockIndex.find(hashBlockPrev);
+            if (it != mapBlockIndex.end())
+                pindex = it->second;
+            else {
+                LogPrintf("GetCoinAge() failed to find block index \n");
+                continue;
+            }
+            outPrev = txPrev.vout[txin.prevout.n];
+        } else if (nBestHeight >= Params().WALLET_UPGRADE_BLOCK() && GetUnspentOutput(txin.prevout, outPrev, pindex)) {
+            // The block of the previous transaction was pruned, its time is only needed before the upgrade
+        } else {
             LogPrintf("GetCoinAge: failed to find vin transaction \n");
             continue; // previous transaction not in main chain
         }
 
-        BlockMap::iterator it = mapBlockIndex.find(hashBlockPrev);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            LogPrintf("GetCoinAge() failed to find block index \n");
-            continue;
-        }
-
         // Read block header
         CBlockHeader prevblock = pindex->GetBlockHeader();
         const int nBlockFromHeight = pindex->nHeight;
@@ -1066,7 +1117,7 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, int nBestHei
         if (nTimeDiff > nStakeMaxAge && nBestHeight >= Params().WALLET_UPGRADE_BLOCK())
             nTimeDiff = nStakeMaxAge;
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
+        int64_t nValueIn = outPrev.nValue;
         bnCentSecond += uint256(nValueIn) * nTimeDiff;
         //LogPrintf("coin age nValueIn=%"PRId64" nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTimeDiff, bnCentSecond.ToString().c_str());
     }
@@ -1184,7 +1235,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1245,10 +1296,12 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
 
         if (isPublicSpend) {
             libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
-            PublicCoinSpend ret(params);
-            if (!ZSPLModule::validateInput(txin, prevOut, tx, ret)){
+            std::shared_ptr<PublicCoinSpend> ret = std::make_shared<PublicCoinSpend>(params);
+            if (!ZSPLModule::validateInput(txin, prevOut, tx, *ret, !pvChecks)){
                 return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend did not verify"));
             }
+            if (pvChecks)
+                pvChecks->push_back(CZerocoinSpendCheck(ret, NULL, tx.GetHash()));
         } else
             // Skip signature verification during initial block download
             if (fVerifySignature) {
@@ -1259,11 +1312,14 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                     return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
                 }
 
-                libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-                                        newSpend.getDenomination(), bnAccumulatorValue);
+                std::shared_ptr<libzerocoin::Accumulator> accumulator = std::make_shared<libzerocoin::Accumulator>(
+                        Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
+                        newSpend.getDenomination(), bnAccumulatorValue);
 
                 //Check that the coin has been accumulated
-                if(!newSpend.Verify(accumulator))
+                if (pvChecks)
+                    pvChecks->push_back(CZerocoinSpendCheck(std::make_shared<libzerocoin::CoinSpend>(newSpend), accumulator, tx.GetHash()));
+                else if(!newSpend.Verify(*accumulator))
                         return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
             }
 
@@ -1284,7 +1340,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1380,7 +1436,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, pvSpendChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1739,7 +1795,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("AcceptToMemoryPool : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1752,7 +1809,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata)) {
             return error("%s : ConnectInputs failed against MANDATORY but not STANDARD flags due to promiscuous mempool %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
@@ -1982,6 +2039,17 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
     return true;
 }
 
+bool GetUnspentOutput(const COutPoint& outpoint, CTxOut& out, CBlockIndex*& pindexFrom)
+{
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    if (!coins || !coins->IsAvailable(outpoint.n) || coins->nHeight < 0 || coins->nHeight > chainActive.Height())
+        return false;
+    out = coins->vout[outpoint.n];
+    pindexFrom = chainActive[coins->nHeight];
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
@@ -2229,7 +2297,7 @@ int64_t GetTreasuryAward(int nHeight)
                 blockValue += chainActive[i]->nMint; // add up coins from previous TreasuryBlockStep blocks
             else {
                 uint64_t nCoinAge = 0;
-                if (chainActive[i]->IsProofOfStake()) {
+                if (chainActive[i]->IsProofOfStake() && !pblocktree->ReadStakeCoinAge(chainActive[i]->GetBlockHash(), nCoinAge)) {
                     CBlock block;
                     ReadBlockFromDisk(block, chainActive[i]);
                     GetCoinAge(block.vtx[1], block.nTime, i, nCoinAge);
@@ -2407,7 +2475,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
@@ -2497,7 +2565,27 @@ CAmount GetInvalidUTXOValue()
     return nValue;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+namespace {
+/**
+ * Transactions whose scripts all passed with a given set of flags, so that
+ * ConnectBlock does not run the interpreter again for what the mempool
+ * already checked. Entries are SHA256(nonce || txid || flags). Guarded by cs_main.
+ */
+CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+uint256 scriptExecutionCacheNonce(GetRandHash());
+}
+
+void InitScriptExecutionCache()
+{
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t)1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+              (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata, std::vector<PrecomputedTransactionData>* pvTxData)
 {
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
         if (pvChecks)
@@ -2558,13 +2646,35 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // The txid commits to every scriptSig and, through the prevouts, to the
+            // scriptPubKeys they spend, so a cached success only depends on the flags.
+            // A reorg cannot change the outcome, and new flags give a new entry.
+            AssertLockHeld(cs_main);
+            uint256 hashCacheEntry;
+            CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheStore))
+                return true;
+
+            // Several inputs share their sighash data, kept by the caller for queued checks
+            std::unique_ptr<PrecomputedTransactionData> txdataLocal;
+            if (!txdata && tx.vin.size() > 1) {
+                if (pvTxData) {
+                    assert(pvTxData->size() < pvTxData->capacity());
+                    pvTxData->emplace_back(tx);
+                    txdata = &pvTxData->back();
+                } else if (!pvChecks) {
+                    txdataLocal.reset(new PrecomputedTransactionData(tx));
+                    txdata = txdataLocal.get();
+                }
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2577,7 +2687,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -2591,6 +2701,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // Every script ran here and passed, remember it for block connection
+            if (cacheStore && !pvChecks)
+                scriptExecutionCache.insert(hashCacheEntry);
         }
     }
 
@@ -2741,6 +2855,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        if (pindex->nHeight >= Params().Zerocoin_StartHeight() && !zerocoinDB->EraseBlockPubcoins(pindex->nHeight))
+            return error("DisconnectBlock(): failed to erase block pubcoins");
     }
 
     if (pfClean) {
@@ -2784,6 +2901,202 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CPoWCheck> powcheckqueue(1);
+//! Header batches come from the net thread and from loadtxoutset, which take turns on the queue
+static CCriticalSection cs_powcheckqueue;
+
+void ThreadPoWCheck()
+{
+    RenameThread("simplicity-powch");
+    powcheckqueue.Thread();
+}
+
+static CCheckQueue<CCoinsPrefetch> prefetchqueue(8);
+
+void ThreadPrefetchInputs()
+{
+    RenameThread("simplicity-prefetch");
+    prefetchqueue.Thread();
+}
+
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendqueue(1);
+//! CheckBlock runs outside cs_main, so its users take turns on the queue
+static CCriticalSection cs_zerocoinspendqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("simplicity-zspch");
+    zerocoinspendqueue.Thread();
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    bool fValid = accumulator ? spend->Verify(*accumulator) : static_cast<const PublicCoinSpend&>(*spend).validate();
+    if (!fValid)
+        return error("CZerocoinSpendCheck() : zerocoin spend in tx %s did not verify", txid.ToString());
+    return true;
+}
+
+void GetCheckQueueStats(std::vector<std::pair<std::string, CCheckQueueStats> >& vStats)
+{
+    vStats.clear();
+    vStats.push_back(std::make_pair("scriptcheck", scriptcheckqueue.GetStats()));
+    vStats.push_back(std::make_pair("powcheck", powcheckqueue.GetStats()));
+    vStats.push_back(std::make_pair("prefetch", prefetchqueue.GetStats()));
+    vStats.push_back(std::make_pair("zerocoinspend", zerocoinspendqueue.GetStats()));
+}
+
+void ThreadFlushCoins()
+{
+    pcoinsflusher->ThreadWriter();
+}
+
+bool CCoinsPrefetch::operator()()
+{
+    // Cancelled prefetches only leave the cache colder
+    if (ShutdownRequested())
+        return true;
+    try {
+        *pfFound = view->GetCoins(txid, *pcoins);
+    } catch (const std::exception& e) {
+        return error("CCoinsPrefetch() : reading %s failed: %s", txid.ToString(), e.what());
+    }
+    return true;
+}
+
+/**
+ * Read the coins spent by block that pcoinsTip does not hold yet from the
+ * coin database on nPrefetchThreads threads, instead of one synchronous
+ * read per miss while the block is connected. Nothing is prefetched once
+ * the cache has reached its size limit.
+ */
+static void PrefetchInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nPrefetchThreads || pcoinsTip->DynamicMemoryUsage() >= nCoinCacheUsage)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setCreated;
+    for (const CTransaction& tx : block.vtx)
+        setCreated.insert(tx.GetHash());
+
+    std::set<uint256> setQueued;
+    std::vector<uint256> vTxid;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx.vin) {
+            const uint256& hash = txin.prevout.hash;
+            if (txin.IsZerocoinSpend() || setCreated.count(hash) || pcoinsTip->HaveCoinsInCache(hash) || !setQueued.insert(hash).second)
+                continue;
+            vTxid.push_back(hash);
+        }
+        if (vTxid.size() >= MAX_PREFETCH_TRANSACTIONS)
+            break;
+    }
+    if (vTxid.empty())
+        return;
+
+    // Only the threads below read from the base view while cs_main keeps pcoinsTip from flushing into it
+    const CCoinsView* view = pcoinsTip->GetBackend();
+    std::vector<CCoins> vCoins(vTxid.size());
+    std::vector<char> vFound(vTxid.size(), 0);
+    std::vector<CCoinsPrefetch> vChecks;
+    vChecks.reserve(vTxid.size());
+    for (unsigned int i = 0; i < vTxid.size(); i++)
+        vChecks.push_back(CCoinsPrefetch(view, vTxid[i], &vCoins[i], &vFound[i]));
+
+    CCheckQueueControl<CCoinsPrefetch> control(&prefetchqueue);
+    control.Add(vChecks);
+    if (!control.Wait() || ShutdownRequested())
+        return;
+
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        if (vFound[i]) {
+            pcoinsTip->WarmCoins(vTxid[i], vCoins[i]);
+            nFound++;
+        }
+    }
+    LogPrint("bench", "  - Prefetch %u/%u transactions: %.2fms\n", nFound, (unsigned int)vTxid.size(), (GetTimeMicros() - nTimeStart) * 0.001);
+}
+
+bool CPoWCheck::operator()()
+{
+    uint256 hashPoW = 0;
+    if (!CheckProofOfWork(&header, hashPoW))
+        return false;
+    *phashPoW = hashPoW;
+    return true;
+}
+
+void ThreadVerifyPoWHashes()
+{
+    std::vector<std::pair<int, CBlockIndex*> > vToVerify;
+    {
+        LOCK(cs_main);
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            if (pindex->IsProofOfWork() && CBlockHeader::GetAlgo(pindex->nVersion) == POW_SCRYPT_SQUARED)
+                vToVerify.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+    }
+    std::sort(vToVerify.begin(), vToVerify.end());
+    LogPrintf("%s : checking %u scrypt² proof-of-work hashes\n", __func__, vToVerify.size());
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nStored = 0;
+    unsigned int nMismatch = 0;
+    unsigned int nInvalid = 0;
+    for (const PAIRTYPE(int, CBlockIndex*) & item : vToVerify) {
+        boost::this_thread::interruption_point();
+
+        CBlockIndex* pindex = item.second;
+        CBlockHeader header;
+        uint256 hashStored = 0;
+        {
+            LOCK(cs_main);
+            header = pindex->GetBlockHeader();
+            if (pindex->HaveProofOfWorkHash())
+                hashStored = pindex->hashProofOfWork;
+        }
+
+        // The hash itself is computed without holding cs_main
+        uint256 hashPoW = header.GetPoWHash();
+
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            if (hashStored == hashPoW)
+                continue;
+            if (hashStored != 0) {
+                LogPrintf("%s : stored proof-of-work hash of block %s is wrong\n", __func__, pindex->GetBlockHash().GetHex());
+                nMismatch++;
+            }
+            if (CheckProofOfWork(&header, hashPoW)) {
+                pindex->SetProofOfWorkHash(hashPoW);
+                setDirtyBlockIndex.insert(pindex);
+                nStored++;
+                continue;
+            }
+
+            // The block was accepted on a wrong hash: it and everything built on it are invalid
+            LogPrintf("%s : block %s at height %d fails its proof-of-work check, invalidating it\n", __func__, pindex->GetBlockHash().GetHex(), pindex->nHeight);
+            pindex->ClearProofOfWorkHash();
+            nInvalid++;
+            if (!InvalidateBlock(state, pindex)) {
+                AbortNode(strprintf("Block %s fails its proof-of-work check and could not be disconnected: %s", pindex->GetBlockHash().GetHex(), FormatStateMessage(state)));
+                return;
+            }
+        }
+        if (state.IsValid())
+            ActivateBestChain(state);
+    }
+
+    LogPrintf("%s : done in %dms, %u hashes added, %u wrong hashes, %u blocks invalidated\n", __func__, GetTimeMillis() - nStart, nStored, nMismatch, nInvalid);
+}
+
 void RecalculateZSPLMinted()
 {
     CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
@@ -2796,17 +3109,10 @@ void RecalculateZSPLMinted()
             uiInterface.ShowProgress(_("Recalculating minted zSPL..."), percent);
         }
 
-        //overwrite possibly wrong vMintsInBlock data
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        std::list<CZerocoinMint> listMints;
-        BlockToZerocoinMintList(block, listMints, true);
-
-        std::vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
-        for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+        //overwrite possibly wrong vMintsInBlock data, from the pubcoin index as the block file may be pruned
+        pindex->ClearMints();
+        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex))
+            pindex->AddMint(pubcoin.getDenomination());
 
         if (pindex->nHeight < chainActive.Height())
             pindex = chainActive.Next(pindex);
@@ -2834,17 +3140,13 @@ void RecalculateZSPLSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
-
-        //Add mints to zSPL supply
-        for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
-        }
+        //and add mints to zSPL supply
+        for (auto denom : libzerocoin::zerocoinDenomList)
+            pindex->SetZcMints(denom, pindex->pprev->GetZcMints(denom) + pindex->GetMintCount(denom));
 
         //Remove spends from zSPL supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->AddZcMints(denom, -1);
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2992,19 +3294,19 @@ bool ReindexAccumulators(std::list<uint256>& listMissingCheckpoints, std::string
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->nVersion >= Params().Zerocoin_HeaderVersion()) {
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
+            pindex->SetZcMints(denom, pindex->pprev->GetZcMints(denom));
         }
     }
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->ClearMints();
     if (pindex->pprev) {
         std::set<uint256> setAddedToWallet;
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->AddMint(denom);
+            pindex->AddZcMints(denom, 1);
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -3029,7 +3331,7 @@ bool ReindexAccumulators(std::list<uint256>& listMissingCheckpoints, std::string
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->AddZcMints(denom, -1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
@@ -3039,7 +3341,7 @@ bool ReindexAccumulators(std::list<uint256>& listMissingCheckpoints, std::string
     }
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->GetZcMints(denom));
 
     return true;
 }*/
@@ -3130,7 +3432,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
+    // Declared before the control so that it outlives the checks still queued on an early return
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(block.vtx.size());
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    CCheckQueueStats statsBefore;
+    if (fScriptChecks && nScriptCheckThreads)
+        statsBefore = scriptcheckqueue.GetStats();
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3275,7 +3583,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, MANDATORY_SCRIPT_VERIFY_FLAGS, false, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, MANDATORY_SCRIPT_VERIFY_FLAGS, false, nScriptCheckThreads ? &vChecks : NULL, NULL, &vTxData))
                 return false;
             control.Add(vChecks);
         }
@@ -3372,6 +3680,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
+    if (fScriptChecks && nScriptCheckThreads) {
+        CCheckQueueStats stats = scriptcheckqueue.GetStats();
+        LogPrint("bench", "      - Script check queue: %u checks in %u batches (%u stolen) on %u threads: %.2fms, %.2fms idle, batch %u (%.1fus/check)\n",
+            stats.nChecks - statsBefore.nChecks, stats.nBatches - statsBefore.nBatches, stats.nSteals - statsBefore.nSteals, stats.nThreads,
+            0.001 * (stats.nWallMicros - statsBefore.nWallMicros), 0.001 * (stats.nIdleMicros - statsBefore.nIdleMicros), stats.nBatchSize, 0.001 * stats.nCheckNanos);
+    }
 
     //IMPORTANT NOTE: Nothing before this point should actually store to disk (or even memory)
     if (fJustCheck)
@@ -3428,6 +3742,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
     if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
 
+    // Index the block's pubcoins so witnesses can be computed without reading the block again
+    if (pindex->nHeight >= Params().Zerocoin_StartHeight()) {
+        std::list<libzerocoin::PublicCoin> listPubcoins;
+        if (!BlockToPubcoinList(block, listPubcoins, true))
+            return state.Abort("Failed to read the pubcoins of the block");
+        if (!listPubcoins.empty() && !zerocoinDB->WriteBlockPubcoins(pindex, listPubcoins))
+            return state.Abort("Failed to record block pubcoins to database");
+    }
+
     //Record accumulator checksums
     //DatabaseChecksums(mapAccumulators);
 
@@ -3435,6 +3758,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    // The treasury award one step later needs the coin age of this stake, by then the previous transactions may be pruned
+    if (block.IsProofOfStake() && pindex->nHeight >= Params().WALLET_UPGRADE_BLOCK() && IsTreasuryBlock(pindex->nHeight))
+        if (!pblocktree->WriteStakeCoinAge(pindex->GetBlockHash(), nCoinAge))
+            return state.Abort("Failed to write stake coin age");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3465,6 +3793,114 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+/** Forget the block and undo data of every block stored in a block file that is about to be deleted */
+static void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::const_iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Pick the oldest block files to delete until the block and undo files fit
+ * in nPruneTarget again. Files holding any block within MIN_BLOCKS_TO_KEEP of
+ * the tip are kept for reorgs. Nothing is pruned before the zerocoin database
+ * indexed the pubcoins of the active chain, which witness computation reads
+ * back, nor before the tip passes the mandatory upgrade block, as coin age
+ * below it needs the time of the transaction that created the stake.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+    if (chainActive.Height() <= std::max(Params().WALLET_UPGRADE_BLOCK(), (int)MIN_BLOCKS_TO_KEEP))
+        return;
+    // The snapshot validation reads the blocks below the snapshot as they come in
+    if (pindexSnapshotBase != NULL)
+        return;
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Height() - MIN_BLOCKS_TO_KEEP;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a nice buffer here in case the pre-allocation runs out.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    if (nCurrentUsage + nBuffer < nPruneTarget)
+        return;
+
+    // Witnesses read pubcoins from the zerocoin database; until it indexed every block of the
+    // active chain the block files are still needed
+    bool fPubcoinsIndexed = false;
+    if (!zerocoinDB->ReadFlag("pubcoinindex", fPubcoinsIndexed) || !fPubcoinsIndexed)
+        return;
+
+    int nCount = 0;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+        if (vinfoBlockFile[fileNumber].nSize == 0)
+            continue;
+        if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+            break;
+        // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
+        if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+            continue;
+
+        PruneOneBlockFile(fileNumber);
+        // Queue up the files for removal
+        setFilesToPrune.insert(fileNumber);
+        nCurrentUsage -= nBytesToPrune;
+        nCount++;
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, nCount);
+}
+
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
@@ -3481,9 +3917,24 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        // The coins cache accounts for its map nodes, bucket array and outputs exactly
+        size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && cacheSize > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -3513,8 +3964,16 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 }
             }
             // Finally flush the chainstate (which may refer to block index entries).
+            // Unless a full write was asked for, the background writer takes it from here.
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            // Deleted files must not be referenced by anything on disk, so pruning
+            // waits for the background writer as well.
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && pcoinsflusher && !pcoinsflusher->Sync())
+                return state.Abort("Failed to write to coin database");
+            // Now that the index no longer points into them, remove the pruned files.
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3532,6 +3991,28 @@ void FlushStateToDisk() {
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush() {
+    {
+        LOCK(cs_main);
+        // A node switching to prune mode may not have stored the coin age of the
+        // last treasury block yet, and the next treasury award depends on it.
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->nHeight > chainActive.Height() - Params().TreasuryBlockStep(); pindex = pindex->pprev) {
+            if (!IsTreasuryBlock(pindex->nHeight))
+                continue;
+            uint64_t nCoinAge = 0;
+            if (pindex->IsProofOfStake() && pindex->nHeight >= Params().WALLET_UPGRADE_BLOCK() && !pblocktree->ReadStakeCoinAge(pindex->GetBlockHash(), nCoinAge)) {
+                CBlock block;
+                if (ReadBlockFromDisk(block, pindex) && GetCoinAge(block.vtx[1], block.nTime, pindex->nHeight, nCoinAge))
+                    pblocktree->WriteStakeCoinAge(pindex->GetBlockHash(), nCoinAge);
+            }
+            break;
+        }
+    }
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -3569,10 +4050,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d version=%d type=%i  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d version=%d type=%i  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), chainActive.Tip()->nVersion, chainActive.Tip()->nVersion >= Params().WALLET_UPGRADE_VERSION() ? CBlockHeader::GetAlgo(chainActive.Tip()->nVersion) : chainActive.Tip()->IsProofOfWork(),
         log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -3670,6 +4151,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchInputs(*pblock);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
@@ -4130,7 +4612,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.Create(block);
     assert(pindexNew);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
@@ -4139,6 +4621,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
+    limitedmap<uint256, uint256>::const_iterator itPoW = mapPendingPoWHashes.find(hash);
+    if (itPoW != mapPendingPoWHashes.end()) {
+        pindexNew->SetProofOfWorkHash(itPoW->second);
+        mapPendingPoWHashes.erase(hash);
+    }
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end()) {
         pindexNew->pprev = (*miPrev).second;
@@ -4264,6 +4751,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -4294,6 +4783,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -4308,24 +4799,162 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+/** Look up a previously verified scrypt² PoW hash for this header */
+static bool GetVerifiedPoWHash(const uint256& hashBlock, uint256& hashPoW)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end() && mi->second->HaveProofOfWorkHash()) {
+        hashPoW = mi->second->hashProofOfWork;
+        return true;
+    }
+    limitedmap<uint256, uint256>::const_iterator it = mapPendingPoWHashes.find(hashBlock);
+    if (it != mapPendingPoWHashes.end()) {
+        hashPoW = it->second;
+        return true;
+    }
+    return false;
+}
+
+/** Store a freshly verified scrypt² PoW hash so it never has to be computed again */
+static void SetVerifiedPoWHash(const uint256& hashBlock, const uint256& hashPoW)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end()) {
+        mi->second->SetProofOfWorkHash(hashPoW);
+        setDirtyBlockIndex.insert(mi->second);
+    } else {
+        mapPendingPoWHashes.insert(std::make_pair(hashBlock, hashPoW));
+    }
+}
+
+void AddVerifiedPoWHashes(const std::map<uint256, uint256>& mapHashes)
+{
+    LOCK(cs_main);
+    if (mapPendingPoWHashes.max_size() < mapHashes.size() + MAX_PENDING_POW_HASHES)
+        mapPendingPoWHashes.max_size(mapHashes.size() + MAX_PENDING_POW_HASHES);
+    for (const std::pair<const uint256, uint256>& item : mapHashes)
+        mapPendingPoWHashes.insert(item);
+}
+
+/** Whether the proof of work of a header has to be checked; old scrypt² headers are only checked when reindexing or verifying */
+static bool IsProofOfWorkCheckRequired(const CBlockHeader& block)
+{
+    // Initialized once even when block import threads get here at the same time
+    static const int64_t nBlockCheckTime = GetTime() - (2 * 24 * 60 * 60); // check the past 2 days worth of headers
+
+    return (fVerifyingBlocks || fReindex || block.nTime >= nBlockCheckTime || CBlockHeader::GetAlgo(block.nVersion) != POW_SCRYPT_SQUARED) && block.IsProofOfWork();
+}
+
+bool HeadersConnect(const std::vector<CBlock>& headers)
 {
-    static int64_t nBlockCheckTime = 0;
+    if (headers.size() < 2)
+        return false;
+    for (unsigned int i = 1; i < headers.size(); i++) {
+        if (headers[i].hashPrevBlock != headers[i - 1].GetHash())
+            return false;
+    }
+    LOCK(cs_main);
+    return mapBlockIndex.count(headers[0].hashPrevBlock) > 0;
+}
+
+bool CheckHeadersProofOfWork(const std::vector<CBlock>& headers)
+{
+    std::vector<uint256> vHashPoW(headers.size());
+    std::vector<CPoWCheck> vChecks;
+    for (unsigned int i = 0; i < headers.size(); i++) {
+        const CBlock& header = headers[i];
+        if (CBlockHeader::GetAlgo(header.nVersion) != POW_SCRYPT_SQUARED || !IsProofOfWorkCheckRequired(header))
+            continue;
+        uint256 hashPoW;
+        if (GetVerifiedPoWHash(header.GetHash(), hashPoW))
+            continue;
+        vChecks.push_back(CPoWCheck(header.GetBlockHeader(), &vHashPoW[i]));
+    }
+    if (vChecks.empty())
+        return true;
+
+    int64_t nStart = GetTimeMicros();
+    unsigned int nChecks = vChecks.size();
+    bool fOk = true;
+    if (nPoWCheckThreads) {
+        // Dispatch a few headers per thread at a time, so a bad header stops the hashing of the rest
+        LOCK(cs_powcheckqueue);
+        size_t nRound = 4 * (nPoWCheckThreads + 1);
+        for (size_t i = 0; i < vChecks.size() && fOk; i += nRound) {
+            std::vector<CPoWCheck> vRound;
+            for (size_t j = i; j < std::min(i + nRound, vChecks.size()); j++) {
+                vRound.push_back(CPoWCheck());
+                vRound.back().swap(vChecks[j]);
+            }
+            CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+            control.Add(vRound);
+            fOk = control.Wait();
+        }
+    } else {
+        for (CPoWCheck& check : vChecks)
+            if (!(fOk = check()))
+                break;
+    }
+    LogPrint("bench", "    - Verify %u header proofs of work: %.2fms\n", nChecks, 0.001 * (GetTimeMicros() - nStart));
+
+    // Failed headers keep a null hash and get rejected by AcceptBlockHeader
+    for (unsigned int i = 0; i < headers.size(); i++) {
+        if (vHashPoW[i] != 0)
+            SetVerifiedPoWHash(headers[i].GetHash(), vHashPoW[i]);
+    }
+
+    // A short batch means we caught up with the peer, so give back the scratchpads of the sync
+    if (headers.size() < MAX_HEADERS_RESULTS)
+        scrypt_pool_trim(1);
 
-    if (nBlockCheckTime == 0)
-        nBlockCheckTime = GetTime() - (2 * 24 * 60 * 60); // check the past 2 days worth of headers
+    return fOk;
+}
 
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+{
     if (block.nVersion >= Params().WALLET_UPGRADE_VERSION() && CBlockHeader::GetAlgo(block.nVersion) == -1)
         return state.DoS(100, error("%s : block %s has an invalid type", __func__, block.GetHash().GetHex()));
 
     // Check proof of work matches claimed amount
-    if ((fVerifyingBlocks || fReindex || block.nTime >= nBlockCheckTime || CBlockHeader::GetAlgo(block.nVersion) != POW_SCRYPT_SQUARED) && fCheckPOW && block.IsProofOfWork() && !CheckProofOfWork(&block))
-        return state.DoS(50, error("%s : proof of work failed", __func__),
-            REJECT_INVALID, "high-hash");
+    bool fScryptSquared = CBlockHeader::GetAlgo(block.nVersion) == POW_SCRYPT_SQUARED;
+    if (fCheckPOW && IsProofOfWorkCheckRequired(block)) {
+        // scrypt² is far too expensive to recompute for headers we have already verified,
+        // so reuse the stored hash and only check it against the target again
+        uint256 hashPoW = 0;
+        bool fStored = fScryptSquared && GetVerifiedPoWHash(block.GetHash(), hashPoW);
+        if (!CheckProofOfWork(&block, hashPoW))
+            return state.DoS(50, error("%s : proof of work failed", __func__),
+                REJECT_INVALID, "high-hash");
+        if (fScryptSquared && !fStored && hashPoW != 0)
+            SetVerifiedPoWHash(block.GetHash(), hashPoW);
+    }
 
     return true;
 }
 
+/**
+ * The expensive checks of CheckBlock that need no chain state: header proof of
+ * work, block signature and merkle root. Does not take cs_main, so block import
+ * runs it on several threads; CheckBlock skips these checks for blocks that pass.
+ */
+static bool PreCheckBlock(const CBlock& block, uint256& hashPoW)
+{
+    CValidationState state;
+    if (!CheckBlockHeader(block, state, false))
+        return false;
+    if (IsProofOfWorkCheckRequired(block) && !CheckProofOfWork(&block, hashPoW))
+        return false;
+    if (!CheckBlockSignature(block))
+        return false;
+    bool mutated;
+    if (block.BuildMerkleTree(&mutated) != block.hashMerkleRoot || mutated)
+        return false;
+    block.fPreChecked = true;
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
 {
     // These are checks that are independent of context.
@@ -4338,11 +4967,11 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
-    if (!CheckBlockHeader(block, state, fCheckPOW))
+    if (!CheckBlockHeader(block, state, fCheckPOW && !block.fPreChecked))
         return state.DoS(100, error("%s : CheckBlockHeader failed", __func__), REJECT_INVALID, "bad-header", true);
 
     // Check proof-of-stake block signature
-    if (fCheckSig && !CheckBlockSignature(block))
+    if (fCheckSig && !block.fPreChecked && !CheckBlockSignature(block))
         return error("%s : bad proof-of-stake block signature", __func__);
 
     // All potential-corruption validation must be done before we do any
@@ -4356,7 +4985,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             REJECT_INVALID, "time-too-new");
 
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !block.fPreChecked) {
         bool mutated;
         uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -4458,13 +5087,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check transactions
     bool fZerocoinActive = nHeight >= Params().Zerocoin_StartHeight();
     std::vector<CBigNum> vBlockSerials;
+    // Spend proofs are verified together once every transaction passed the cheap checks
+    std::vector<CZerocoinSpendCheck> vSpendChecks;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     // int blockHeight = chainActive.Height() + 1;
     for (const CTransaction& tx : block.vtx) {
         if (tx.nVersion < 3 && block.nVersion >= Params().WALLET_UPGRADE_VERSION())
             return state.DoS(100, error("%s : Transaction %s has invalid version %d", __func__, tx.GetHash().ToString(), tx.nVersion),
                 REJECT_INVALID, "bad-txns-version");
-        if (!CheckTransaction(tx, fZerocoinActive, nHeight >= Params().Zerocoin_Block_EnforceSerialRange(), state))
+        if (!CheckTransaction(tx, fZerocoinActive, nHeight >= Params().Zerocoin_Block_EnforceSerialRange(), state, nScriptCheckThreads ? &vSpendChecks : NULL))
             return error("%s : CheckTransaction of %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
 
         // double check that there are no double spent zSPL spends in this block
@@ -4492,6 +5123,21 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    if (!vSpendChecks.empty()) {
+        int64_t nStart = GetTimeMicros();
+        unsigned int nChecks = vSpendChecks.size();
+        bool fOk;
+        {
+            LOCK(cs_zerocoinspendqueue);
+            CCheckQueueControl<CZerocoinSpendCheck> control(&zerocoinspendqueue);
+            control.Add(vSpendChecks);
+            fOk = control.Wait();
+        }
+        LogPrint("bench", "    - Verify %u zerocoin spends: %.2fms\n", nChecks, 0.001 * (GetTimeMicros() - nStart));
+        if (!fOk)
+            return state.DoS(100, error("%s : invalid zerocoin spend", __func__));
+    }
+
 
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx) {
@@ -4991,9 +5637,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Create();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -5003,12 +5647,27 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(std::string& strError)
 {
+    int64_t nTimeStart = GetTimeMicros();
+    // An index without a version predates the version key and loads as it is
+    int nIndexVersion = 1;
+    pblocktree->ReadInt("blockindexversion", nIndexVersion);
+    if (nIndexVersion > BLOCK_INDEX_VERSION) {
+        strError = strprintf(_("The block index was written by a newer version of Simplicity (block index version %d, this version reads up to %d)"), nIndexVersion, BLOCK_INDEX_VERSION);
+        return false;
+    }
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
+    if (nIndexVersion < BLOCK_INDEX_VERSION) {
+        LogPrintf("%s: upgrading block index from version %d to %d\n", __func__, nIndexVersion, BLOCK_INDEX_VERSION);
+        if (!pblocktree->WriteInt("blockindexversion", BLOCK_INDEX_VERSION))
+            return error("%s: failed to write the block index version", __func__);
+    }
+    LogPrint("bench", "    - Block index: %u entries, %ukB\n", blockIndexArena.Size(), blockIndexArena.DynamicMemoryUsage() / 1024);
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
+    int64_t nTime1 = GetTimeMicros();
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
@@ -5016,13 +5675,17 @@ bool static LoadBlockIndexDB(std::string& strError)
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint("bench", "    - Sort block index by height: %.2fms\n", (nTime2 - nTime1) * 0.001);
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
 
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // LoadBlockIndexGuts left the work of the block itself in nChainWork
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->nChainWork;
+        // Blocks below a UTXO snapshot or in pruned files keep their transaction count
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -5043,6 +5706,8 @@ bool static LoadBlockIndexDB(std::string& strError)
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nTime3 = GetTimeMicros();
+    LogPrint("bench", "    - Link chain work, skip list and candidates: %.2fms\n", (nTime3 - nTime2) * 0.001);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -5061,6 +5726,11 @@ bool static LoadBlockIndexDB(std::string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -5076,6 +5746,8 @@ bool static LoadBlockIndexDB(std::string& strError)
             return false;
         }
     }
+    LogPrint("bench", "    - Block file info and presence: %.2fms\n", (GetTimeMicros() - nTime3) * 0.001);
+    LogPrint("bench", "- Load block index: %.2fms\n", (GetTimeMicros() - nTimeStart) * 0.001);
 
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
@@ -5091,6 +5763,13 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Continue validating the chain below a loaded UTXO snapshot
+    uint256 hashSnapshotBase, hashSnapshotCoins;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase, hashSnapshotCoins) && mapBlockIndex.count(hashSnapshotBase)) {
+        pindexSnapshotBase = mapBlockIndex[hashSnapshotBase];
+        LogPrintf("%s: the chain below the UTXO snapshot at height %d is not validated yet\n", __func__, pindexSnapshotBase->nHeight);
+    }
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -5143,6 +5822,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        // blocks below the base of a UTXO snapshot or in pruned files have nothing on disk to verify
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -5161,7 +5843,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -5205,6 +5887,7 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
+    pindexSnapshotBase = NULL;
     mempool.clear();
     mapOrphanTransactions.clear();
     mapOrphanTransactionsByPrev.clear();
@@ -5221,10 +5904,8 @@ void UnloadBlockIndex()
     mapNodeState.clear();
     recentRejects.reset(NULL);
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -5232,6 +5913,97 @@ bool LoadBlockIndex(std::string& strError)
     // Load block index from databases
     if (!fReindex && !LoadBlockIndexDB(strError))
         return false;
+    // A reindex starts from a wiped index that gets written in the current layout
+    if (fReindex && !pblocktree->WriteInt("blockindexversion", BLOCK_INDEX_VERSION))
+        return error("%s: failed to write the block index version", __func__);
+    return true;
+}
+
+bool LoadSnapshotChain(const std::vector<CDiskBlockIndex>& vIndex, const uint256& hashCoins, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+
+    if (vIndex.empty() || vIndex[0].GetBlockHash() != Params().HashGenesisBlock()) {
+        strError = "snapshot chain does not start at the genesis block";
+        return false;
+    }
+
+    // Same steps as LoadBlockIndexGuts and LoadBlockIndexDB, for blocks whose
+    // data will never be on disk. Headers we already know are overwritten.
+    std::vector<const CBlockIndex*> vWrite;
+    vWrite.reserve(vIndex.size());
+    CBlockIndex* pindexBase = chainActive.Genesis();
+    for (const CDiskBlockIndex& diskindex : vIndex) {
+        if (diskindex.hashPrev == 0)
+            continue;
+
+        CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+        pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+        if (pindexNew->pprev != pindexBase || diskindex.nHeight != pindexBase->nHeight + 1) {
+            strError = strprintf("snapshot block %s does not extend its predecessor", diskindex.GetBlockHash().ToString());
+            return false;
+        }
+        pindexNew->nHeight = diskindex.nHeight;
+        pindexNew->nVersion = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime = diskindex.nTime;
+        pindexNew->nBits = diskindex.nBits;
+        pindexNew->nNonce = diskindex.nNonce;
+        pindexNew->nStatus = (diskindex.nStatus & ~(BLOCK_HAVE_MASK | BLOCK_FAILED_MASK)) | BLOCK_SNAPSHOT;
+        pindexNew->nTx = diskindex.nTx;
+        pindexNew->nMint = diskindex.nMint;
+        pindexNew->nMoneySupply = diskindex.nMoneySupply;
+        pindexNew->nFlags = diskindex.nFlags;
+        if (Params().IsStakeModifierV2(pindexNew->nHeight))
+            pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+        pindexNew->hashProofOfWork = diskindex.hashProofOfWork;
+
+        pindexNew->nChainWork = pindexBase->nChainWork + GetBlockProof(*pindexNew);
+        pindexNew->nChainTx = pindexBase->nChainTx + pindexNew->nTx;
+        pindexNew->BuildSkip();
+        if (pindexNew->IsValid(BLOCK_VALID_TRANSACTIONS))
+            setBlockIndexCandidates.insert(pindexNew);
+        if (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindexNew))
+            pindexBestHeader = pindexNew;
+
+        vWrite.push_back(pindexNew);
+        pindexBase = pindexNew;
+    }
+
+    for (size_t i = 0; i < vWrite.size(); i += SNAPSHOT_INDEX_BATCH_SIZE) {
+        std::vector<const CBlockIndex*> vBatch(vWrite.begin() + i, vWrite.begin() + std::min(vWrite.size(), i + SNAPSHOT_INDEX_BATCH_SIZE));
+        if (!pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), nLastBlockFile, vBatch)) {
+            strError = "failed to write snapshot block index";
+            return false;
+        }
+    }
+
+    // The pubcoins of the blocks below the snapshot are indexed once they are downloaded, at a later start
+    if (!zerocoinDB->WriteFlag("pubcoinindex", false)) {
+        strError = "failed to reset the pubcoin index state";
+        return false;
+    }
+
+    // Written before the best block, so that the snapshot is validated whenever the chainstate refers to it
+    if (!pblocktree->WriteSnapshotBase(pindexBase->GetBlockHash(), hashCoins)) {
+        strError = "failed to write snapshot base";
+        return false;
+    }
+    pindexSnapshotBase = pindexBase;
+
+    // The chainstate on disk only refers to the snapshot once its best block is written
+    chainActive.SetTip(pindexBase);
+    PruneBlockIndexCandidates();
+    pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+    CValidationState state;
+    if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS)) {
+        strError = FormatStateMessage(state);
+        return false;
+    }
+
+    LogPrintf("%s: hashBestChain=%s height=%d date=%s\n", __func__,
+        chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()));
     return true;
 }
 
@@ -5279,65 +6051,142 @@ bool InitBlockIndex() {
 }
 
 
+namespace
+{
+/** A block on its way through the block file import pipeline */
+struct CImportBlock {
+    CDiskBlockPos pos;
+    bool fHavePos;
+    std::vector<char> vData;
+    CBlock block;
+    uint256 hashPoW;
+    bool fDecoded;
+
+    CImportBlock() : fHavePos(false), hashPoW(0), fDecoded(false) {}
+};
+typedef COrderedPipeline<CImportBlock> CBlockImportPipeline;
+
+/** Reader stage of the import: locate the blocks in the file and queue their raw data */
+void ReadImportBlocks(CBufferedFile& blkdat, const CDiskBlockPos* dbp, CBlockImportPipeline& pipeline)
+{
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+
+        std::shared_ptr<CImportBlock> item = std::make_shared<CImportBlock>();
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            if (dbp) {
+                item->pos = *dbp;
+                item->pos.nPos = nBlockPos;
+                item->fHavePos = true;
+            }
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            item->vData.resize(nSize);
+            blkdat.read(&item->vData[0], nSize);
+            nRewind = blkdat.GetPos();
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            continue;
+        }
+
+        if (!pipeline.Push(item, nSize))
+            break;
+    }
+}
+
+/** Decoder stage of the import: deserialize a block and run PreCheckBlock */
+void DecodeImportBlock(CImportBlock& item)
+{
+    try {
+        CDataStream ss(item.vData, SER_DISK, CLIENT_VERSION);
+        std::vector<char>().swap(item.vData);
+        ss >> item.block;
+        item.fDecoded = true;
+    } catch (const std::exception& e) {
+        LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+
+    if (item.fDecoded) {
+        CBlock& block = item.block;
+        if (block.nVersion < Params().WALLET_UPGRADE_VERSION() && block.vtx.size() > 1 && block.vtx[1].IsCoinStake())
+            block.fPreForkPoS = true;
+        // Blocks failing here are simply checked again, and rejected, by ProcessNewBlock
+        if (!PreCheckBlock(block, item.hashPoW))
+            item.hashPoW = 0;
+    }
+}
+} // anon namespace
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    int64_t nTimeWait = 0;
 
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // Build the lazily initialized zerocoin parameters before decoder threads verify zerocoin stake signatures
+        Params().Zerocoin_Params(false);
+        // A reader thread locates the blocks in the file, decoder threads deserialize them and run
+        // PreCheckBlock, and this thread hands them to ProcessNewBlock in file order.
+        // Decoding is dominated by scrypt² proof-of-work hashes, so it gets the -parpow threads and their scratchpads
+        CBlockImportPipeline pipeline(MAX_IMPORT_QUEUE_BLOCKS, MAX_IMPORT_QUEUE_BYTES);
+        pipeline.Start("imp", [&](CBlockImportPipeline& p) { ReadImportBlocks(blkdat, dbp, p); }, DecodeImportBlock, std::max(nPoWCheckThreads, 1));
+        std::shared_ptr<CImportBlock> item;
+        while (true) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+            int64_t nTimeWaitStart = GetTimeMicros();
+            if (!pipeline.Next(item))
                 break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+            nTimeWait += GetTimeMicros() - nTimeWaitStart;
+            if (!item->fDecoded)
+                continue;
 
+            CBlock& block = item->block;
+            CDiskBlockPos* pos = item->fHavePos ? &item->pos : NULL;
+            try {
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
                 if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                    if (pos)
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *pos));
                     continue;
                 }
 
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                    if (item->hashPoW != 0 && CBlockHeader::GetAlgo(block.nVersion) == POW_SCRYPT_SQUARED)
+                        SetVerifiedPoWHash(hash, item->hashPoW);
                     CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, true, dbp))
+                    if (ProcessNewBlock(state, NULL, &block, true, pos))
                         nLoaded++;
                     if (state.IsError())
                         break;
@@ -5372,11 +6221,16 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
+        pipeline.Stop();
+        std::string strReadError = pipeline.GetReadError();
+        if (!strReadError.empty())
+            throw std::runtime_error(strReadError);
     } catch (std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    LogPrint("bench", "    - Wait for block file reading and decoding: %.2fms\n", nTimeWait * 0.001);
     return nLoaded > 0;
 }
 
@@ -5416,6 +6270,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -5423,6 +6278,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -5433,12 +6289,18 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 (we stored the number of transactions in the block)
+        if (!fHavePruned) {
+            // Unless files were pruned, HAVE_DATA is also equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0) || (pindex->nStatus & BLOCK_SNAPSHOT));
+        } else if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            // Once pruned, HAVE_DATA only implies nTx > 0
+            assert(pindex->nTx > 0);
+        }
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having been processed is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx == 0 is used to signal that all parent block's transaction data was processed.
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -5450,7 +6312,7 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL && (pindexFirstMissing == NULL || pindex == chainActive.Tip())) {
             if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
                 assert(setBlockIndexCandidates.count(pindex));
             }
@@ -5468,8 +6330,8 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
+        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstNeverProcessed != NULL) {
+            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent was never processed, and has no invalid parents, it must be in mapBlocksUnlinked.
                 assert(foundInUnlinked);
             }
         } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
@@ -5493,6 +6355,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -5777,8 +6640,8 @@ void static ProcessGetData(CNode* pfrom)
                                 }
                             }
                         }
-                        // Don't send not-validated blocks
-                        if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                        // Don't send not-validated blocks; the pubcoins of pruned active chain blocks come from the index
+                        if (send && ((mi->second->nStatus & BLOCK_HAVE_DATA) || chainActive.Contains(mi->second))) {
                             try {
                                 std::list<libzerocoin::PublicCoin> pubcoins = GetPubcoinFromBlock((*mi).second);
                                 CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -6285,6 +7148,11 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // Don't announce blocks whose data was pruned, the peer could not download them from us
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", "  getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0)
             {
@@ -6540,6 +7408,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             //ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Check the scrypt² proofs of work of the whole batch on the PoW check threads before
+        // taking cs_main; AcceptBlockHeader then finds them verified and rejects the bad ones.
+        // Only a batch that chains up and extends a block we know is worth the work, anything
+        // else is handled below without hashing a single header.
+        if (HeadersConnect(headers))
+            CheckHeadersProofOfWork(headers);
+
         {
         LOCK(cs_main);
 
@@ -7483,6 +8358,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             NodeId staller = -1;
 
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindSnapshotBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
             for (CBlockIndex* pindex : vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
@@ -7588,10 +8464,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -35,6 +35,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -48,15 +49,19 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CCoinsViewFlusher;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
 struct CBlockTemplate;
+struct CCheckQueueStats;
 struct CNodeStateStats;
 
 inline int64_t GetMNCollateral(int nHeight) { return 200000; }
@@ -89,9 +94,23 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 32;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of zerocoin spend checking threads, taken from -par next to the script-checking threads */
+static const int MAX_SPENDCHECK_THREADS = 8;
+/** Maximum number of header proof-of-work checking threads allowed, each needs a 128 MB scrypt² scratchpad */
+static const int MAX_POWCHECK_THREADS = 8;
+/** -parpow default (number of header proof-of-work checking threads, 0 = auto) */
+static const int DEFAULT_POWCHECK_THREADS = 0;
+/** Number of threads -parpow=0 picks at most */
+static const int DEFAULT_MAX_AUTO_POWCHECK_THREADS = 4;
+/** Maximum number of input prefetching threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -parprefetch default (number of threads reading block inputs from the coin database, 0 = off) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Maximum number of transactions whose coins are prefetched for one block */
+static const unsigned int MAX_PREFETCH_TRANSACTIONS = 20000;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -142,11 +161,22 @@ static const unsigned char REJECT_DUST = 0x41;
 static const unsigned char REJECT_INSUFFICIENTFEE = 0x42;
 static const unsigned char REJECT_CHECKPOINT = 0x43;
 
-/** zSPL precomputing variables
- * Set the number of included blocks to precompute per cycle. */
-static const int DEFAULT_PRECOMPUTE_LENGTH = 1000;
-static const int MIN_PRECOMPUTE_LENGTH = 500;
-static const int MAX_PRECOMPUTE_LENGTH = 2000;
+/** Default for -asyncflush, write flushed coins in the background instead of under cs_main */
+static const bool DEFAULT_ASYNC_COINS_FLUSH = true;
+/** Number of block index entries of a loaded UTXO snapshot written to the block tree per batch */
+static const size_t SNAPSHOT_INDEX_BATCH_SIZE = 50000;
+
+/** Default for -verifypowhashes, re-verify stored scrypt² proof-of-work hashes in the background */
+static const bool DEFAULT_VERIFY_POW_HASHES = false;
+/** Maximum number of verified PoW hashes kept for headers that are not in the block index yet */
+static const unsigned int MAX_PENDING_POW_HASHES = 2 * MAX_HEADERS_RESULTS;
+/** Maximum number of blocks read from a block file ahead of the one being connected during -reindex or -loadblock */
+static const unsigned int MAX_IMPORT_QUEUE_BLOCKS = 512;
+/** Maximum number of bytes of blocks read ahead during -reindex or -loadblock, a single larger block is still allowed */
+static const size_t MAX_IMPORT_QUEUE_BYTES = 64 * 1000 * 1000;
+
+/** Default for -precompute, keeping zSPL spend witnesses up to date with the tip */
+static const bool DEFAULT_PRECOMPUTE = true;
 
 struct BlockHasher {
     size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
@@ -166,10 +196,15 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPoWCheckThreads;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
+extern bool fHavePruned;
+extern bool fPruneMode;
+extern uint64_t nPruneTarget;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
-extern unsigned int nCoinCacheSize;
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern int64_t nMaxTipAge;
@@ -192,6 +227,9 @@ extern std::map<uint256, int64_t> mapZerocoinspends; //txid, time received
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex* pindexBestHeader;
 
+/** Base of a loaded UTXO snapshot while the blocks below it are still being validated, NULL otherwise */
+extern CBlockIndex* pindexSnapshotBase;
+
 /**  */
 extern CLightWorker lightWorker;
 
@@ -200,6 +238,11 @@ static const uint64_t nMinDiskSpace = 52428800;
 
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 2160; // number of blocks in 2 days
+/**
+ * Require at least 550MiB for block and undo files with -prune: one full block
+ * file with its undo data above the blocks kept for reorgs, and room for those.
+ */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
@@ -227,6 +270,10 @@ FILE* OpenBlockFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
+/** Calculate the amount of disk space the block and undo files currently use */
+uint64_t CalculateCurrentUsage();
+/** Delete the block and undo files of a set of pruned block file numbers */
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -235,6 +282,8 @@ bool InitBlockIndex();
 bool LoadBlockIndex(std::string& strError);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Add the active chain of a loaded UTXO snapshot to the block index, make its last block the tip and schedule the validation of the chain below it */
+bool LoadSnapshotChain(const std::vector<CDiskBlockIndex>& vIndex, const uint256& hashCoins, std::string& strError);
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
 /** Process protocol messages received from a given node */
@@ -248,6 +297,24 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadPoWCheck();
+/** Run an instance of the block input prefetching thread */
+void ThreadPrefetchInputs();
+/** Run an instance of the zerocoin spend proof checking thread */
+void ThreadZerocoinSpendCheck();
+/** Run the thread writing flushed coins to the coin database */
+void ThreadFlushCoins();
+/** Counters of the script, header proof-of-work, input prefetch and zerocoin spend check queues, by name */
+void GetCheckQueueStats(std::vector<std::pair<std::string, CCheckQueueStats> >& vStats);
+/** Whether a batch of several headers chains up and extends a block in mapBlockIndex, so its proofs of work are worth checking */
+bool HeadersConnect(const std::vector<CBlock>& headers);
+/** Verify the scrypt² proofs of work of a batch of connecting headers in parallel, stopping at the first failure and remembering the verified hashes. Callers on different threads take turns on the check threads */
+bool CheckHeadersProofOfWork(const std::vector<CBlock>& headers);
+/** Recompute stored proof-of-work hashes and fill in the ones missing from older block index records */
+void ThreadVerifyPoWHashes();
+/** Remember PoW hashes verified by a previous block index, so -reindex does not recompute them */
+void AddVerifiedPoWHashes(const std::map<uint256, uint256>& mapHashes);
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -257,6 +324,8 @@ std::string GetWarnings(std::string strFor);
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
+/** Find an unspent output and the block that created it in the coin database, for when the block file of its transaction was pruned */
+bool GetUnspentOutput(const COutPoint& outpoint, CTxOut& out, CBlockIndex*& pindexFrom);
 /** Find the best known block, and make it the tip of the block chain */
 
 // ***TODO***
@@ -278,6 +347,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
 
 
 /** (try to) add transaction to memory pool **/
@@ -367,17 +438,24 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. Scripts that already passed inline with the same flags and
+ * cacheStore set, as in the mempool, are not run again. The script checks hash signatures through
+ * txdata when given; it must outlive the checks pushed onto pvChecks. Otherwise the data of a
+ * transaction with several inputs is built only when its scripts are run, in pvTxData when given,
+ * which must have the capacity for it and outlive the checks as well.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL, const PrecomputedTransactionData* txdata = NULL, std::vector<PrecomputedTransactionData>* pvTxData = NULL);
+
+/** Initializes the script execution cache */
+void InitScriptExecutionCache();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+/** Context-independent validity checks. Zerocoin spend proofs are appended to pvSpendChecks when given, instead of being verified */
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -440,12 +518,13 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData *txdata;
 
 public:
-    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = NULL) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
 
@@ -456,11 +535,86 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the proof-of-work check of one header
+ * The computed PoW hash is written to the slot passed in
+ */
+class CPoWCheck
+{
+private:
+    CBlockHeader header;
+    uint256* phashPoW;
+
+public:
+    CPoWCheck(): phashPoW(NULL) {}
+    CPoWCheck(const CBlockHeader& headerIn, uint256* phashPoWIn) : header(headerIn), phashPoW(phashPoWIn) {}
+
+    bool operator()();
+
+    void swap(CPoWCheck& check) {
+        std::swap(header, check.header);
+        std::swap(phashPoW, check.phashPoW);
+    }
+};
+
+/**
+ * Closure reading the coins of one transaction from the view below pcoinsTip,
+ * so they are in the cache when the block spending them is connected.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView* view;
+    uint256 txid;
+    CCoins* pcoins;
+    char* pfFound;
+
+public:
+    CCoinsPrefetch(): view(NULL), pcoins(NULL), pfFound(NULL) {}
+    CCoinsPrefetch(const CCoinsView* viewIn, const uint256& txidIn, CCoins* pcoinsIn, char* pfFoundIn) : view(viewIn), txid(txidIn), pcoins(pcoinsIn), pfFound(pfFoundIn) {}
+
+    bool operator()();
+
+    void swap(CCoinsPrefetch& check) {
+        std::swap(view, check.view);
+        std::swap(txid, check.txid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
+/**
+ * Closure verifying the proof of one zerocoin spend: the accumulator proof and
+ * serial signature of knowledge of a private spend against the accumulator
+ * read beforehand, or the commitment and signature of a public spend.
+ */
+class CZerocoinSpendCheck
+{
+private:
+    std::shared_ptr<const libzerocoin::CoinSpend> spend;
+    //! NULL for a public spend
+    std::shared_ptr<const libzerocoin::Accumulator> accumulator;
+    uint256 txid;
+
+public:
+    CZerocoinSpendCheck() {}
+    CZerocoinSpendCheck(const std::shared_ptr<const libzerocoin::CoinSpend>& spendIn, const std::shared_ptr<const libzerocoin::Accumulator>& accumulatorIn, const uint256& txidIn) : spend(spendIn), accumulator(accumulatorIn), txid(txidIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check) {
+        spend.swap(check.spend);
+        accumulator.swap(check.accumulator);
+        std::swap(txid, check.txid);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
@@ -484,6 +638,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckWork(const CBlockHeader& block, CBlockIndex* const pindexPrev);
+/** Convert CValidationState to a human-readable message for logging */
+std::string FormatStateMessage(const CValidationState& state);
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 
@@ -653,6 +809,12 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the coin database (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
+/** Global variable that points to the layer writing pcoinsTip flushes in the background (may be NULL) */
+extern CCoinsViewFlusher* pcoinsflusher;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
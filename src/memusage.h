@@ -0,0 +1,48 @@
+// Copyright (c) 2015 The Bitcoin developers
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMUSAGE_H
+#define BITCOIN_MEMUSAGE_H
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace memusage
+{
+
+/** Compute the memory used for dynamically allocated but owned data structures.
+ *  For generic data types, this is *not* recursive. DynamicUsage(vector<vector<int> >)
+ *  will compute the memory used for the vector<int>'s, but not for the ints inside.
+ *  This is for efficiency reasons, as these functions are intended to be fast. If
+ *  application data structures require more accurate inner accounting, they should
+ *  do the recursion themselves, or use more efficient caching + updating on modification.
+ */
+
+/** Compute the total memory used by allocating alloc bytes. */
+static inline size_t MallocUsage(size_t alloc)
+{
+    // Measured on libc6 2.19 on Linux.
+    if (alloc == 0) {
+        return 0;
+    } else if (sizeof(void*) == 8) {
+        return ((alloc + 31) >> 4) << 4;
+    } else if (sizeof(void*) == 4) {
+        return ((alloc + 15) >> 3) << 3;
+    } else {
+        assert(0);
+    }
+}
+
+template <typename X>
+static inline size_t DynamicUsage(const std::vector<X>& v)
+{
+    return MallocUsage(v.capacity() * sizeof(X));
+}
+
+} // namespace memusage
+
+#endif // BITCOIN_MEMUSAGE_H
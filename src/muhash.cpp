@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/sha512.h"
+#include "hash.h"
+
+#include <vector>
+
+namespace
+{
+const CBigNum& Modulus()
+{
+    static const CBigNum bnModulus = (CBigNum(1) << 3072) - CBigNum(1103717);
+    return bnModulus;
+}
+
+/** Expand an element to 3072 bits with six SHA512 calls and reduce it into the group */
+CBigNum ToGroupElement(const unsigned char* pch, size_t nSize)
+{
+    unsigned char digest[CSHA512::OUTPUT_SIZE];
+    CSHA512().Write(pch, nSize).Finalize(digest);
+
+    // 384 little endian bytes plus a zero byte that keeps the number positive
+    std::vector<unsigned char> vch(3072 / 8 + 1, 0);
+    for (unsigned char i = 0; i < 6; i++) {
+        CSHA512().Write(digest, sizeof(digest)).Write(&i, 1).Finalize(&vch[i * CSHA512::OUTPUT_SIZE]);
+    }
+    CBigNum bn(vch);
+    if (bn >= Modulus())
+        bn = bn % Modulus();
+    return bn;
+}
+} // anon namespace
+
+CMuHash3072::CMuHash3072() : numerator(1), denominator(1)
+{
+}
+
+void CMuHash3072::Insert(const unsigned char* pch, size_t nSize)
+{
+    numerator = numerator.mul_mod(ToGroupElement(pch, nSize), Modulus());
+}
+
+void CMuHash3072::Remove(const unsigned char* pch, size_t nSize)
+{
+    denominator = denominator.mul_mod(ToGroupElement(pch, nSize), Modulus());
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& other)
+{
+    numerator = numerator.mul_mod(other.numerator, Modulus());
+    denominator = denominator.mul_mod(other.denominator, Modulus());
+    return *this;
+}
+
+void CMuHash3072::Normalize()
+{
+    if (denominator == CBigNum(1))
+        return;
+    numerator = numerator.mul_mod(denominator.inverse(Modulus()), Modulus());
+    denominator = 1;
+}
+
+uint256 CMuHash3072::GetHash() const
+{
+    CMuHash3072 normalized(*this);
+    normalized.Normalize();
+    std::vector<unsigned char> vch = normalized.numerator.getvch();
+    vch.resize(3072 / 8 + 1, 0);
+    return Hash(vch.begin(), vch.end());
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_MUHASH_H
+#define SIMPLICITY_MUHASH_H
+
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stddef.h>
+
+/**
+ * Order-independent hash of a multiset of byte strings (MuHash).
+ *
+ * Every element is expanded to a number modulo the prime 2^3072 - 1103717.
+ * Insert multiplies it into the numerator and Remove into the denominator,
+ * so a set hashes the same no matter in which order it was built, and an
+ * element can be taken out again without touching the rest of the set.
+ */
+class CMuHash3072
+{
+private:
+    CBigNum numerator;
+    CBigNum denominator;
+
+public:
+    //! The hash of the empty set
+    CMuHash3072();
+
+    void Insert(const unsigned char* pch, size_t nSize);
+    void Remove(const unsigned char* pch, size_t nSize);
+
+    //! Combine with the elements of another set
+    CMuHash3072& operator*=(const CMuHash3072& other);
+
+    //! Fold the denominator into the numerator, costs one modular inversion
+    void Normalize();
+
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // SIMPLICITY_MUHASH_H
@@ -0,0 +1,163 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_ORDEREDPIPELINE_H
+#define SIMPLICITY_ORDEREDPIPELINE_H
+
+#include "concurrentqueue.h"
+#include "util.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * Three stages connected by bounded queues: a reader thread produces items in
+ * order, decoder threads process them in any order, and the calling thread
+ * takes them back in the order they were produced. Besides the number of
+ * queued items, the reader can be held back by a budget on the summed cost of
+ * the items the caller did not take yet. The destructor stops and joins the
+ * threads, so the pipeline has to be declared after what its stages refer to.
+ */
+template <typename T>
+class COrderedPipeline
+{
+public:
+    typedef std::shared_ptr<T> Ref;
+    typedef std::function<void(COrderedPipeline<T>&)> ReadFunc;
+    typedef std::function<void(T&)> DecodeFunc;
+
+private:
+    struct CEntry {
+        Ref item;
+        size_t nCost;
+        bool fDone;
+
+        CEntry(const Ref& itemIn, size_t nCostIn) : item(itemIn), nCost(nCostIn), fDone(false) {}
+    };
+    typedef std::shared_ptr<CEntry> CEntryRef;
+
+    //! Items in production order, waiting for the caller
+    concurrentqueue<CEntryRef> queueOrdered;
+    //! Items waiting to be decoded
+    concurrentqueue<CEntryRef> queueDecode;
+    boost::thread_group threads;
+
+    std::mutex cs;
+    std::condition_variable condDone;
+    std::condition_variable condCost;
+    size_t nMaxCost;
+    size_t nQueuedCost;
+    bool fStopped;
+    std::string strReadError;
+
+    void ThreadRead(const std::string& strName, ReadFunc fnRead)
+    {
+        RenameThread(("simplicity-" + strName).c_str());
+        try {
+            fnRead(*this);
+        } catch (const std::exception& e) {
+            std::unique_lock<std::mutex> lock(cs);
+            strReadError = e.what();
+        }
+        queueOrdered.close();
+        queueDecode.close();
+    }
+
+    void ThreadDecode(const std::string& strName, DecodeFunc fnDecode)
+    {
+        RenameThread(("simplicity-" + strName).c_str());
+        CEntryRef entry;
+        while (queueDecode.pop(entry)) {
+            fnDecode(*entry->item);
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                entry->fDone = true;
+            }
+            condDone.notify_all();
+            entry.reset();
+        }
+    }
+
+public:
+    //! nMaxCostIn of 0 leaves only the number of queued items bounded
+    COrderedPipeline(size_t nMaxQueued, size_t nMaxCostIn = 0) : queueOrdered(nMaxQueued), queueDecode(nMaxQueued), nMaxCost(nMaxCostIn), nQueuedCost(0), fStopped(false) {}
+
+    ~COrderedPipeline()
+    {
+        Stop();
+        threads.join_all();
+    }
+
+    /**
+     * Start the reader thread, which runs fnRead handing its items to Push,
+     * and nDecodeThreads threads running fnDecode on them. An exception thrown
+     * by fnRead ends the input and is kept for GetReadError; fnDecode has to
+     * record its failures in the item instead of throwing.
+     */
+    void Start(const std::string& strName, ReadFunc fnRead, DecodeFunc fnDecode, int nDecodeThreads)
+    {
+        threads.create_thread(boost::bind(&COrderedPipeline<T>::ThreadRead, this, strName + "read", fnRead));
+        for (int i = 0; i < nDecodeThreads; i++)
+            threads.create_thread(boost::bind(&COrderedPipeline<T>::ThreadDecode, this, strName + "dec", fnDecode));
+    }
+
+    //! Called by the reader to queue the next item; false once the pipeline is stopped
+    bool Push(const Ref& item, size_t nCost = 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condCost.wait(lock, [&]{ return fStopped || nMaxCost == 0 || nQueuedCost == 0 || nQueuedCost + nCost <= nMaxCost; });
+            if (fStopped)
+                return false;
+            nQueuedCost += nCost;
+        }
+        CEntryRef entry = std::make_shared<CEntry>(item, nCost);
+        return queueOrdered.push(entry) && queueDecode.push(entry);
+    }
+
+    //! Wait for the next decoded item in production order; false once all items are done
+    bool Next(Ref& item)
+    {
+        CEntryRef entry;
+        if (!queueOrdered.pop(entry))
+            return false;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condDone.wait(lock, [&]{ return fStopped || entry->fDone; });
+            if (!entry->fDone)
+                return false;
+            nQueuedCost -= entry->nCost;
+        }
+        condCost.notify_all();
+        item = entry->item;
+        return true;
+    }
+
+    void Stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            fStopped = true;
+        }
+        condCost.notify_all();
+        condDone.notify_all();
+        queueOrdered.close();
+        queueDecode.close();
+    }
+
+    std::string GetReadError()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return strReadError;
+    }
+};
+
+#endif // SIMPLICITY_ORDEREDPIPELINE_H
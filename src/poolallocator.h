@@ -0,0 +1,255 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POOLALLOCATOR_H
+#define BITCOIN_POOLALLOCATOR_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory resource that carves small blocks out of large chunks.
+ *
+ * Requests of up to MAX_BLOCK_SIZE bytes are rounded up to a multiple of
+ * ALIGN and, once released, kept on a free list per size. A node based
+ * container that keeps inserting and erasing entries therefore reuses the
+ * same chunks instead of fragmenting the heap, and its memory usage is known
+ * exactly. Larger requests (such as hash table bucket arrays) go straight to
+ * operator new, but are still accounted for.
+ *
+ * Chunks are only given back by Release(). Like the containers using it, a
+ * CPoolResource is not thread-safe.
+ */
+template <size_t MAX_BLOCK_SIZE, size_t ALIGN>
+class CPoolResource
+{
+private:
+    struct ListNode {
+        ListNode* next;
+    };
+
+    static_assert(ALIGN >= sizeof(ListNode) && (ALIGN & (ALIGN - 1)) == 0, "ALIGN must be a power of two that can hold a free list link");
+    static_assert(MAX_BLOCK_SIZE % ALIGN == 0, "MAX_BLOCK_SIZE must be a multiple of ALIGN");
+
+    //! size of each chunk requested from operator new
+    const size_t nChunkSize;
+
+    //! released blocks, indexed by their size in units of ALIGN
+    std::vector<ListNode*> vFreeLists;
+
+    //! all chunks, to be freed on Release() or destruction
+    std::vector<char*> vChunks;
+
+    //! unused remainder of the most recent chunk
+    char* pAvailableBegin;
+    char* pAvailableEnd;
+
+    //! bytes of pooled blocks currently handed out
+    size_t nPooledInUse;
+
+    //! malloc usage of the requests that bypassed the pool
+    size_t nLargeUsage;
+
+    CPoolResource(const CPoolResource&);
+    CPoolResource& operator=(const CPoolResource&);
+
+    static bool IsPooled(size_t nBytes, size_t nAlignment)
+    {
+        return nBytes <= MAX_BLOCK_SIZE && nAlignment <= ALIGN;
+    }
+
+    static size_t SizeClass(size_t nBytes)
+    {
+        return nBytes == 0 ? 1 : (nBytes + ALIGN - 1) / ALIGN;
+    }
+
+    void PushFree(void* p, size_t nClass)
+    {
+        ListNode* node = new (p) ListNode;
+        node->next = vFreeLists[nClass];
+        vFreeLists[nClass] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // Keep what is left of the current chunk on the free list of its size
+        size_t nRemaining = pAvailableEnd - pAvailableBegin;
+        if (nRemaining > 0)
+            PushFree(pAvailableBegin, nRemaining / ALIGN);
+
+        char* chunk = static_cast<char*>(::operator new(nChunkSize));
+        vChunks.push_back(chunk);
+        pAvailableBegin = chunk;
+        pAvailableEnd = chunk + nChunkSize;
+    }
+
+    void FreeChunks()
+    {
+        for (char* chunk : vChunks)
+            ::operator delete(chunk);
+        std::vector<char*>().swap(vChunks);
+        vFreeLists.assign(vFreeLists.size(), NULL);
+        pAvailableBegin = pAvailableEnd = NULL;
+    }
+
+public:
+    explicit CPoolResource(size_t nChunkSizeIn = 256 * 1024) : nChunkSize(nChunkSizeIn - nChunkSizeIn % ALIGN),
+                                                                vFreeLists(MAX_BLOCK_SIZE / ALIGN + 1, NULL),
+                                                                pAvailableBegin(NULL),
+                                                                pAvailableEnd(NULL),
+                                                                nPooledInUse(0),
+                                                                nLargeUsage(0)
+    {
+        assert(nChunkSize >= MAX_BLOCK_SIZE);
+    }
+
+    ~CPoolResource()
+    {
+        FreeChunks();
+    }
+
+    void* Allocate(size_t nBytes, size_t nAlignment)
+    {
+        if (!IsPooled(nBytes, nAlignment)) {
+            nLargeUsage += memusage::MallocUsage(nBytes);
+            return ::operator new(nBytes);
+        }
+
+        size_t nClass = SizeClass(nBytes);
+        nPooledInUse += nClass * ALIGN;
+        if (vFreeLists[nClass] != NULL) {
+            ListNode* node = vFreeLists[nClass];
+            vFreeLists[nClass] = node->next;
+            return node;
+        }
+        if ((size_t)(pAvailableEnd - pAvailableBegin) < nClass * ALIGN)
+            AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nClass * ALIGN;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nBytes, size_t nAlignment)
+    {
+        if (!IsPooled(nBytes, nAlignment)) {
+            nLargeUsage -= memusage::MallocUsage(nBytes);
+            ::operator delete(p);
+            return;
+        }
+
+        size_t nClass = SizeClass(nBytes);
+        nPooledInUse -= nClass * ALIGN;
+        PushFree(p, nClass);
+    }
+
+    //! Give all chunks back; only allowed while no pooled block is handed out
+    void Release()
+    {
+        assert(nPooledInUse == 0);
+        FreeChunks();
+    }
+
+    //! Memory held by this resource, including chunk space that is not handed out
+    size_t DynamicMemoryUsage() const
+    {
+        return vChunks.size() * memusage::MallocUsage(nChunkSize) + memusage::DynamicUsage(vChunks) +
+               memusage::DynamicUsage(vFreeLists) + nLargeUsage;
+    }
+
+    //! Bytes of pooled blocks currently handed out
+    size_t PooledBytesInUse() const
+    {
+        return nPooledInUse;
+    }
+};
+
+/** STL allocator drawing from a CPoolResource, which must outlive it. */
+template <typename T, size_t MAX_BLOCK_SIZE, size_t ALIGN>
+class pool_allocator
+{
+public:
+    typedef CPoolResource<MAX_BLOCK_SIZE, ALIGN> resource_type;
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U, MAX_BLOCK_SIZE, ALIGN> other;
+    };
+
+    explicit pool_allocator(resource_type* resourceIn) throw() : resource(resourceIn) {}
+    pool_allocator(const pool_allocator& a) throw() : resource(a.resource) {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U, MAX_BLOCK_SIZE, ALIGN>& a) throw() : resource(a.resource)
+    {
+    }
+    ~pool_allocator() throw() {}
+
+    T* allocate(size_t n, const void* hint = 0)
+    {
+        if (n > max_size())
+            throw std::bad_alloc();
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    size_t max_size() const throw()
+    {
+        return std::numeric_limits<size_t>::max() / sizeof(T);
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+
+    resource_type* get_resource() const
+    {
+        return resource;
+    }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U, MAX_BLOCK_SIZE, ALIGN>& a) const
+    {
+        return resource == a.resource;
+    }
+
+    template <typename U>
+    bool operator!=(const pool_allocator<U, MAX_BLOCK_SIZE, ALIGN>& a) const
+    {
+        return resource != a.resource;
+    }
+
+private:
+    template <typename U, size_t M, size_t A>
+    friend class pool_allocator;
+
+    resource_type* resource;
+};
+
+#endif // BITCOIN_POOLALLOCATOR_H
@@ -116,6 +116,12 @@ unsigned int GetLegacyNextWorkRequired(const CBlockIndex* pindexLast, const CBlo
 }
 
 bool CheckProofOfWork(const CBlockHeader* pblock)
+{
+    uint256 hashPoW = 0;
+    return CheckProofOfWork(pblock, hashPoW);
+}
+
+bool CheckProofOfWork(const CBlockHeader* pblock, uint256& hashPoW)
 {
     bool fNegative;
     bool fOverflow;
@@ -137,7 +143,9 @@ bool CheckProofOfWork(const CBlockHeader* pblock)
     }
 
     // Check proof of work matches claimed amount
-    if (pblock->GetPoWHash() > bnTarget) {
+    if (hashPoW == 0)
+        hashPoW = pblock->GetPoWHash();
+    if (hashPoW > bnTarget) {
         if (Params().MineBlocksOnDemand())
             return false;
         else if (pblock->GetHash() == Params().HashGenesisBlock() && Params().NetworkID() == CBaseChainParams::MAIN) {
@@ -29,6 +29,8 @@ unsigned int GetLegacyNextWorkRequired(const CBlockIndex* pindexLast, const CBlo
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(const CBlockHeader* pblock/*, uint256 hash, unsigned int nBits*/);
+/** Same as above, but reuses hashPoW if it is non-zero and otherwise returns the computed PoW hash in it */
+bool CheckProofOfWork(const CBlockHeader* pblock, uint256& hashPoW);
 uint256 GetBlockProof(const CBlockIndex& block);
 
 #endif // BITCOIN_POW_H
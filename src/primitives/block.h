@@ -157,6 +157,7 @@ public:
     // memory only
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
+    mutable bool fPreChecked; // proof of work, signature and merkle root already verified by PreCheckBlock
 
     CBlock()
     {
@@ -184,6 +185,7 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         vMerkleTree.clear();
+        fPreChecked = false;
         payee = CScript();
         vchBlockSig.clear();
     }
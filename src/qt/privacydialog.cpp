@@ -726,7 +726,7 @@ void PrivacyDialog::setBalance(const CAmount& balance, const CAmount& unconfirme
     ui->labelZsupplyAmount_2->setText(QString::number(chainActive.Tip()->GetZerocoinSupply()/COIN) + QString(" <b>zSPL </b> "));
 
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        int64_t nSupply = chainActive.Tip()->mapZerocoinSupply.at(denom);
+        int64_t nSupply = chainActive.Tip()->GetZcMints(denom);
         QString strSupply = QString::number(nSupply) + " x " + QString::number(denom) + " = <b>" +
                             QString::number(nSupply*denom) + " zSPL </b> ";
         switch (denom) {
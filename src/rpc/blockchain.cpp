@@ -7,6 +7,7 @@
 
 #include "base58.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "clientversion.h"
 #include "kernel.h"
 #include "main.h"
@@ -16,6 +17,7 @@
 #include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxosnapshot.h"
 #include "zspl/accumulatormap.h"
 #include "zspl/accumulators.h"
 #include "wallet/wallet.h"
@@ -176,7 +178,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     UniValue zsplObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zsplObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zsplObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->GetZcMints(denom) * (denom*COIN))));
     }
     zsplObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.push_back(Pair("zSPLsupply", zsplObj));
@@ -206,7 +208,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         result.push_back(Pair("CoinStake", stakeData));
     } else {
         UniValue workData(UniValue::VOBJ);
-        workData.push_back(Pair("hashProofOfWork", block.GetPoWHash().GetHex()));
+        workData.push_back(Pair("hashProofOfWork", (blockindex->HaveProofOfWorkHash() ? blockindex->hashProofOfWork : block.GetPoWHash()).GetHex()));
         result.push_back(Pair("Mined", workData));
     }
 
@@ -291,6 +293,9 @@ UniValue getchecksumblock(const UniValue& params, bool fHelp)
     if (!fVerbose)
         return pblockindex->GetBlockHash().GetHex();
 
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
     CBlock block;
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
@@ -687,6 +692,9 @@ UniValue getblock(const UniValue& params, bool fHelp)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -758,7 +766,6 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
         throw std::runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
 
             "\nResult:\n"
             "{\n"
@@ -767,7 +774,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) Order-independent hash of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
@@ -792,6 +799,99 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue SnapshotInfoToJSON(const CSnapshotInfo& info, const boost::filesystem::path& path)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", info.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", info.nHeight));
+    ret.push_back(Pair("block_index", (int64_t)info.nBlockIndex));
+    ret.push_back(Pair("coins", (int64_t)info.nCoins));
+    ret.push_back(Pair("zerocoin_records", (int64_t)info.nZerocoin));
+    ret.push_back(Pair("hash", info.hashSnapshot.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"filename\"\n"
+            "\nWrites the unspent transaction output set, the block index of the active chain and the\n"
+            "zerocoin database at the current tip to a snapshot file. Nodes loading it need its hash\n"
+            "from a source they trust.\n"
+            "Note this call may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The snapshot file, relative to the data directory. It must not exist yet.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",      (string) the block the snapshot was taken at\n"
+            "  \"base_height\": n,         (numeric) the height of that block\n"
+            "  \"block_index\": n,         (numeric) the number of block index entries written\n"
+            "  \"coins\": n,               (numeric) the number of unspent outputs written\n"
+            "  \"zerocoin_records\": n,    (numeric) the number of zerocoin database records written\n"
+            "  \"hash\": \"hash\",           (string) the hash of the unspent outputs and zerocoin records\n"
+            "  \"path\": \"path\"            (string) the absolute path of the file\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CSnapshotInfo info;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotInfoToJSON(info, path);
+}
+
+UniValue loadtxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw std::runtime_error(
+            "loadtxoutset \"filename\" \"hash\"\n"
+            "\nLoads a snapshot written by dumptxoutset and continues the chain from its block.\n"
+            "Only possible on a node that has not connected any block beyond genesis yet. The headers\n"
+            "are checked before anything is written, and the records are removed again if they do\n"
+            "not match the expected hash.\n"
+            "The blocks below the snapshot are then downloaded and replayed in the background, which\n"
+            "has to arrive at the same unspent outputs. Until then, outputs created below the snapshot\n"
+            "are not used for staking and block files are not pruned.\n"
+
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The snapshot file, relative to the data directory\n"
+            "2. \"hash\"        (string, required) The hash dumptxoutset reported for the snapshot, from a\n"
+            "                  trusted source\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",      (string) the block the snapshot was taken at, now the tip\n"
+            "  \"base_height\": n,         (numeric) the height of that block\n"
+            "  \"block_index\": n,         (numeric) the number of block index entries loaded\n"
+            "  \"coins\": n,               (numeric) the number of unspent outputs loaded\n"
+            "  \"zerocoin_records\": n,    (numeric) the number of zerocoin database records loaded\n"
+            "  \"hash\": \"hash\",           (string) the verified hash of the snapshot\n"
+            "  \"path\": \"path\"            (string) the absolute path of the file\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("loadtxoutset", "\"utxo.dat\" \"hash\"") + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", \"hash\""));
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    uint256 hashExpected = ParseHashV(params[1], "hash");
+
+    CSnapshotInfo info;
+    std::string strError;
+    if (!LoadUTXOSnapshot(path, hashExpected, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotInfoToJSON(info, path);
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -947,6 +1047,8 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored, only present if pruning is enabled\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -975,6 +1077,14 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode) {
+        CBlockIndex* block = chainActive.Tip();
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
     //CBlockIndex* tip = chainActive.Tip();
     //UniValue softforks(UniValue::VARR);
     //softforks.push_back(SoftForkDesc("bip65", 5, tip));
@@ -1154,6 +1264,54 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getcheckqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getcheckqueueinfo\n"
+            "\nReturns statistics of the queues verifying scripts, header proofs of work and zerocoin spends, and prefetching block inputs.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (string) Queue name: scriptcheck, powcheck, prefetch or zerocoinspend\n"
+            "    \"threads\": n,           (numeric) Threads taking part, including the one waiting for the result\n"
+            "    \"runs\": n,              (numeric) Number of times the queue was run\n"
+            "    \"checks\": n,            (numeric) Number of checks executed\n"
+            "    \"batches\": n,           (numeric) Number of batches the checks were executed in\n"
+            "    \"steals\": n,            (numeric) Number of batches taken from another thread\n"
+            "    \"walltime\": n,          (numeric) Time the runs took, in milliseconds\n"
+            "    \"busytime\": n,          (numeric) Time spent executing checks over all threads, in milliseconds\n"
+            "    \"idletime\": n,          (numeric) Thread time of the runs not spent executing checks, in milliseconds\n"
+            "    \"batchsize\": n,         (numeric) Current batch size\n"
+            "    \"checktime\": n          (numeric) Average time of a check the batch size follows, in microseconds\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getcheckqueueinfo", "") + HelpExampleRpc("getcheckqueueinfo", ""));
+
+    std::vector<std::pair<std::string, CCheckQueueStats> > vStats;
+    GetCheckQueueStats(vStats);
+
+    UniValue ret(UniValue::VOBJ);
+    for (const std::pair<std::string, CCheckQueueStats>& item : vStats) {
+        const CCheckQueueStats& stats = item.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("threads", (int)stats.nThreads));
+        obj.push_back(Pair("runs", (uint64_t)stats.nRuns));
+        obj.push_back(Pair("checks", (uint64_t)stats.nChecks));
+        obj.push_back(Pair("batches", (uint64_t)stats.nBatches));
+        obj.push_back(Pair("steals", (uint64_t)stats.nSteals));
+        obj.push_back(Pair("walltime", 0.001 * stats.nWallMicros));
+        obj.push_back(Pair("busytime", 0.001 * stats.nBusyMicros));
+        obj.push_back(Pair("idletime", 0.001 * stats.nIdleMicros));
+        obj.push_back(Pair("batchsize", (int)stats.nBatchSize));
+        obj.push_back(Pair("checktime", 0.001 * stats.nCheckNanos));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1419,7 +1577,7 @@ UniValue getmintsinblocks(const UniValue& params, bool fHelp) {
         CBlockIndex* pindex = chainActive[heightStart];
 
         while (true) {
-            num_of_mints += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+            num_of_mints += pindex->GetMintCount(denom);
             if (pindex->nHeight < heightEnd) {
                 pindex = chainActive.Next(pindex);
             } else {
@@ -1690,7 +1848,7 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
         // add mints to map
         if (!fFeeOnly) {
             for (auto& denom : libzerocoin::zerocoinDenomList) {
-                mapMintCount[denom] += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+                mapMintCount[denom] += pindex->GetMintCount(denom);
             }
         }
 
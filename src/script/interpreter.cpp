@@ -1110,9 +1110,81 @@ public:
     }
 };
 
+/** Stream feeding a single SHA256, so that its state can be kept between inputs */
+class CSHA256Writer
+{
+private:
+    CSHA256 ctx;
+
+public:
+    int nType;
+    int nVersion;
+
+    CSHA256Writer() : nType(SER_GETHASH), nVersion(0) {}
+    CSHA256Writer(const CSHA256& ctxIn) : ctx(ctxIn), nType(SER_GETHASH), nVersion(0) {}
+
+    CSHA256Writer& write(const char* pch, size_t size)
+    {
+        ctx.Write((const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    template <typename T>
+    CSHA256Writer& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    const CSHA256& GetState() const { return ctx; }
+
+    //! Double SHA256 of everything written, like CHashWriter. Invalidates the object
+    uint256 GetHash()
+    {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        ctx.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize(result.begin());
+        return result;
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& tx)
+{
+    // An input index past the end never matches, so every input gets an empty script
+    CTransactionSignatureSerializer txTmp(tx, CScript(), tx.vin.size(), SIGHASH_ALL);
+
+    CDataStream ssInputs(SER_GETHASH, 0);
+    vInputOffsets.reserve(tx.vin.size() + 1);
+    for (unsigned int nInput = 0; nInput < tx.vin.size(); nInput++) {
+        vInputOffsets.push_back(ssInputs.size());
+        txTmp.SerializeInput(ssInputs, nInput, SER_GETHASH, 0);
+    }
+    vInputOffsets.push_back(ssInputs.size());
+    vchInputs.assign(ssInputs.begin(), ssInputs.end());
+
+    CDataStream ssOutputs(SER_GETHASH, 0);
+    ::WriteCompactSize(ssOutputs, tx.vout.size());
+    for (unsigned int nOutput = 0; nOutput < tx.vout.size(); nOutput++)
+        txTmp.SerializeOutput(ssOutputs, nOutput, SER_GETHASH, 0);
+    ssOutputs << tx.nLockTime;
+    vchOutputs.assign(ssOutputs.begin(), ssOutputs.end());
+
+    CSHA256Writer ss;
+    ss << tx.nVersion;
+    if (tx.nVersion < 3)
+        ss << tx.nTime;
+    ::WriteCompactSize(ss, tx.vin.size());
+    vMidstates.reserve(tx.vin.size());
+    for (unsigned int nInput = 0; nInput < tx.vin.size(); nInput++) {
+        vMidstates.push_back(ss.GetState());
+        ss.write((const char*)&vchInputs[vInputOffsets[nInput]], vInputOffsets[nInput + 1] - vInputOffsets[nInput]);
+    }
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1131,6 +1203,17 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    if (txdata && nHashType == SIGHASH_ALL && txdata->vMidstates.size() == txTo.vin.size()) {
+        // Resume after the inputs before nIn, then only nIn's script has to be serialized
+        CSHA256Writer ss(txdata->vMidstates[nIn]);
+        txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+        size_t nSuffix = txdata->vInputOffsets[nIn + 1];
+        ss.write((const char*)txdata->vchInputs.data() + nSuffix, txdata->vchInputs.size() - nSuffix);
+        ss.write((const char*)txdata->vchOutputs.data(), txdata->vchOutputs.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1155,7 +1238,7 @@ bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vch
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash)) {
         return false;
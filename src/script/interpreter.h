@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -91,7 +92,26 @@ enum
     SCRIPT_VERIFY_NULLFAIL = (1U << 14)
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * Parts of the SIGHASH_ALL serialization of a transaction that are the same for every
+ * input, so that checking or signing all inputs does not serialize the transaction once
+ * per input. Other hash types are computed in full.
+ */
+struct PrecomputedTransactionData
+{
+    //! SHA256 state after the version, the input count and the inputs before each input
+    std::vector<CSHA256> vMidstates;
+    //! Every input serialized with an empty script
+    std::vector<unsigned char> vchInputs;
+    //! Offset of each input in vchInputs, followed by its size
+    std::vector<size_t> vInputOffsets;
+    //! The output count, the outputs and the lock time
+    std::vector<unsigned char> vchOutputs;
+
+    explicit PrecomputedTransactionData(const CTransaction& tx);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = NULL);
 
 class BaseSignatureChecker
 {
@@ -114,12 +134,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
 };
@@ -174,31 +174,45 @@ bool CSplStake::SetInput(CTransaction txPrev, unsigned int n)
 {
     this->txFrom = txPrev;
     this->nPosition = n;
+    this->hashFrom = txPrev.GetHash();
+    this->outFrom = txPrev.vout[n];
+    return true;
+}
+
+bool CSplStake::SetPrevout(const COutPoint& prevout, const CTxOut& out, CBlockIndex* pindex)
+{
+    this->txFrom = CTransaction();
+    this->nPosition = prevout.n;
+    this->hashFrom = prevout.hash;
+    this->outFrom = out;
+    this->pindexFrom = pindex;
     return true;
 }
 
 bool CSplStake::GetTxFrom(CTransaction& tx)
 {
+    if (txFrom.IsNull())
+        return false;
     tx = txFrom;
     return true;
 }
 
 bool CSplStake::CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut)
 {
-    txIn = CTxIn(txFrom.GetHash(), nPosition);
+    txIn = CTxIn(hashFrom, nPosition);
     return true;
 }
 
 CAmount CSplStake::GetValue()
 {
-    return txFrom.vout[nPosition].nValue;
+    return outFrom.nValue;
 }
 
 bool CSplStake::CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal)
 {
     std::vector<valtype> vSolutions;
     txnouttype whichType;
-    CScript scriptPubKeyKernel = txFrom.vout[nPosition].scriptPubKey;
+    CScript scriptPubKeyKernel = outFrom.scriptPubKey;
     if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
         LogPrintf("CreateCoinStake : failed to parse kernel\n");
         return false;
@@ -277,7 +291,7 @@ CDataStream CSplStake::GetUniqueness()
 {
     //The unique identifier for a SPL stake is the outpoint
     CDataStream ss(SER_NETWORK, 0);
-    ss << nPosition << txFrom.GetHash();
+    ss << nPosition << hashFrom;
     return ss;
 }
 
@@ -288,7 +302,7 @@ CBlockIndex* CSplStake::GetIndexFrom()
         return pindexFrom;
     uint256 hashBlock = 0;
     CTransaction tx;
-    if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
+    if (GetTransaction(hashFrom, tx, hashBlock, true)) {
         // If the index is in the chain, then set it as the "index from"
         if (mapBlockIndex.count(hashBlock)) {
             CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
@@ -296,7 +310,13 @@ CBlockIndex* CSplStake::GetIndexFrom()
                 pindexFrom = pindex;
         }
     } else {
-        LogPrintf("%s : failed to find tx %s\n", __func__, txFrom.GetHash().GetHex());
+        // The block holding the transaction may have been pruned, the coins view still knows its height
+        CTxOut out;
+        CBlockIndex* pindex = NULL;
+        if (GetUnspentOutput(COutPoint(hashFrom, nPosition), out, pindex))
+            pindexFrom = pindex;
+        else
+            LogPrintf("%s : failed to find tx %s\n", __func__, hashFrom.GetHex());
     }
 
     return pindexFrom;
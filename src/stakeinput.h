@@ -77,6 +77,9 @@ class CSplStake : public CStakeInput
 private:
     CTransaction txFrom;
     unsigned int nPosition;
+    // the staked output, known even when txFrom can no longer be read from disk
+    uint256 hashFrom;
+    CTxOut outFrom;
 
     // cached data
     uint64_t nStakeModifier = 0;
@@ -86,6 +89,8 @@ public:
     CSplStake(){}
 
     bool SetInput(CTransaction txPrev, unsigned int n);
+    //! Stake an unspent output found in the coins view, for blocks whose files were pruned
+    bool SetPrevout(const COutPoint& prevout, const CTxOut& out, CBlockIndex* pindex);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
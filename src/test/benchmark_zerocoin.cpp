@@ -368,6 +368,39 @@ Testb_MintAndSpend()
     return false;
 }
 
+bool
+Testb_ModExp()
+{
+    const CBigNum& modulus = gg_Params->accumulatorParams.accumulatorModulus;
+    std::shared_ptr<CBigNumModExp> pExp = CBigNumModExp::Get(modulus);
+    CBigNum base = CBigNum::randBignum(modulus);
+
+    for (int nBits = 32; nBits <= 1024; nBits *= 4) {
+        CBigNum e = CBigNum::randKBitBignum(nBits);
+        CBigNum r1, r2;
+
+        timer.start();
+        for (uint32_t i = 0; i < TESTS_COINS_TO_ACCUMULATE; i++)
+            r1 = base.pow_mod(e, modulus);
+        timer.stop();
+        double nPlain = timer.duration();
+
+        timer.start();
+        for (uint32_t i = 0; i < TESTS_COINS_TO_ACCUMULATE; i++)
+            r2 = pExp->pow_mod(base, e);
+        timer.stop();
+
+        if (r1 != r2) {
+            std::cout << "Cached exponentiation does not match pow_mod" << std::endl;
+            return false;
+        }
+
+        std::cout << "\tMODEXP " << nBits << "-BIT EXPONENT:\n\t\tpow_mod: " << nPlain/TESTS_COINS_TO_ACCUMULATE << " ms per op\n\t\tcached: " << timer.duration()/TESTS_COINS_TO_ACCUMULATE << " ms per op" << std::endl;
+    }
+
+    return true;
+}
+
 void
 Testb_RunAllTests()
 {
@@ -387,6 +420,7 @@ Testb_RunAllTests()
     gLogTestResult("coins can be minted", Testb_MintCoin);
     gLogTestResult("the accumulator works", Testb_Accumulator);
     gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
+    gLogTestResult("cached modular exponentiation matches pow_mod", Testb_ModExp);
 
     // Summarize test results
     if (ggSuccessfulTests < ggNumTests) {
@@ -0,0 +1,120 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_simplicity.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace
+{
+/** Counts its executions and returns a fixed result */
+struct CCountCheck {
+    std::atomic<int>* pnCount;
+    bool fResult;
+
+    CCountCheck() : pnCount(NULL), fResult(true) {}
+    CCountCheck(std::atomic<int>* pnCountIn, bool fResultIn = true) : pnCount(pnCountIn), fResult(fResultIn) {}
+
+    bool operator()()
+    {
+        (*pnCount)++;
+        return fResult;
+    }
+
+    void swap(CCountCheck& check)
+    {
+        std::swap(pnCount, check.pnCount);
+        std::swap(fResult, check.fResult);
+    }
+};
+
+typedef CCheckQueue<CCountCheck> CCountQueue;
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run)
+{
+    CCountQueue queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 7; i++)
+        threadGroup.create_thread(boost::bind(&CCountQueue::Thread, &queue));
+
+    for (int nRound = 0; nRound < 20; nRound++) {
+        std::atomic<int> nCount(0);
+        int nAdded = 0;
+        {
+            CCheckQueueControl<CCountCheck> control(&queue);
+            // Mix single checks, as added per transaction, with large batches
+            for (int i = 0; i < 200; i++) {
+                std::vector<CCountCheck> vChecks(i % 10 == 0 ? 500 : 1, CCountCheck(&nCount));
+                nAdded += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nCount.load(), nAdded);
+    }
+
+    CCheckQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nRuns, 20U);
+    BOOST_CHECK_EQUAL(stats.nChecks, 20U * (180 + 20 * 500));
+    // Workers that have not started yet do not count
+    BOOST_CHECK(stats.nThreads >= 1 && stats.nThreads <= 8);
+    BOOST_CHECK(stats.nBatches <= stats.nChecks);
+    BOOST_CHECK(stats.nBatchSize >= 1 && stats.nBatchSize <= 128);
+    BOOST_CHECK(queue.IsIdle());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCountQueue queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCountQueue::Thread, &queue));
+
+    std::atomic<int> nCount(0);
+    {
+        CCheckQueueControl<CCountCheck> control(&queue);
+        std::vector<CCountCheck> vChecks(1000, CCountCheck(&nCount));
+        vChecks[500] = CCountCheck(&nCount, false);
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+
+    // A failure does not stick to the next run
+    {
+        CCheckQueueControl<CCountCheck> control(&queue);
+        std::vector<CCountCheck> vChecks(1000, CCountCheck(&nCount));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK(queue.IsIdle());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // Without workers the master executes everything in Wait()
+    CCountQueue queue(128);
+    std::atomic<int> nCount(0);
+    CCheckQueueControl<CCountCheck> control(&queue);
+    std::vector<CCountCheck> vChecks(300, CCountCheck(&nCount));
+    control.Add(vChecks);
+    BOOST_CHECK(control.Wait());
+    BOOST_CHECK_EQUAL(nCount.load(), 300);
+    BOOST_CHECK_EQUAL(queue.GetStats().nSteals, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
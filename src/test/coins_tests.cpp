@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "test/test_simplicity.h"
 
@@ -11,6 +12,7 @@
 #include <map>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
@@ -59,6 +61,12 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true, true) {}
+};
 }
 
 BOOST_FIXTURE_TEST_SUITE(coins_tests, BasicTestingSetup)
@@ -176,4 +184,223 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Check that the per-outpoint chainstate round-trips partially spent
+// transactions, and that old per-transaction records are upgraded.
+BOOST_FIXTURE_TEST_CASE(coins_db_outpoint_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    uint256 txid = GetRandHash();
+
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 1000;
+    coins.fCoinStake = true;
+    coins.vout.resize(3);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = 1000 + i;
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    {
+        CCoinsViewCache cache(&base);
+        *cache.ModifyCoins(txid) = coins;
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins read;
+    BOOST_CHECK(base.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+
+    // Spend the middle output only
+    {
+        CCoinsViewCache cache(&base);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        BOOST_CHECK(cache.Flush());
+    }
+    coins.vout[1].SetNull();
+    BOOST_CHECK(base.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+
+    // Spend the rest
+    {
+        CCoinsViewCache cache(&base);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            BOOST_CHECK(modifier->Spend(0));
+            BOOST_CHECK(modifier->Spend(2));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!base.HaveCoins(txid));
+    BOOST_CHECK(!base.GetCoins(txid, read));
+
+    // A per-transaction record left by an older version is converted
+    uint256 txidOld = GetRandHash();
+    CCoins coinsOld;
+    coinsOld.nVersion = 1;
+    coinsOld.nHeight = 500;
+    coinsOld.fCoinBase = true;
+    coinsOld.vout.resize(2);
+    coinsOld.vout[1].nValue = 50;
+    coinsOld.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    BOOST_CHECK(base.GetDB().Write(std::make_pair('c', txidOld), coinsOld));
+    BOOST_CHECK(!base.HaveCoins(txidOld));
+    BOOST_CHECK(base.Upgrade());
+    BOOST_CHECK(!base.GetDB().Exists(std::make_pair('c', txidOld)));
+    BOOST_CHECK(base.GetCoins(txidOld, read));
+    BOOST_CHECK(read == coinsOld);
+}
+
+// Check that the statistics kept up to date on every write match a full rescan.
+BOOST_FIXTURE_TEST_CASE(coins_db_stats_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    BOOST_CHECK(base.Upgrade());
+
+    std::vector<uint256> txids;
+    for (int nFlush = 0; nFlush < 4; nFlush++) {
+        CCoinsViewCache cache(&base);
+        for (unsigned int i = 0; i < 20; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier coins = cache.ModifyCoins(txids.back());
+            coins->nVersion = 1;
+            coins->nHeight = 100 + nFlush;
+            coins->vout.resize(3);
+            for (unsigned int n = 0; n < coins->vout.size(); n++) {
+                coins->vout[n].nValue = 1000 * nFlush + n + 1;
+                coins->vout[n].scriptPubKey = CScript() << OP_TRUE;
+            }
+        }
+        // Spend some outputs written by earlier flushes, some of them completely
+        for (unsigned int i = 0; i < txids.size(); i += 7) {
+            CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+            coins->Spend(i % 3);
+            if (i % 2)
+                coins->Spend((i + 1) % 3);
+        }
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsStats stats;
+    BOOST_CHECK(base.GetStats(stats));
+    BOOST_CHECK(stats.nTransactionOutputs > 0);
+
+    BOOST_CHECK(base.RebuildStats());
+    CCoinsStats statsRebuilt;
+    BOOST_CHECK(base.GetStats(statsRebuilt));
+    BOOST_CHECK_EQUAL(stats.nTransactions, statsRebuilt.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsRebuilt.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, statsRebuilt.nSerializedSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, statsRebuilt.nTotalAmount);
+    BOOST_CHECK(stats.hashSerialized == statsRebuilt.hashSerialized);
+}
+
+// Check that the cache accounts for its entries and gives the memory back on flush.
+BOOST_AUTO_TEST_CASE(coins_cache_memory_usage)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+
+    CCoins coins;
+    coins.vout.resize(4);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = i + 1;
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    for (unsigned int i = 0; i < 1000; i++)
+        *cache.ModifyCoins(GetRandHash()) = coins;
+
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage + 1000 * (sizeof(CCoinsCacheEntry) + coins.DynamicMemoryUsage()));
+
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nEmptyUsage);
+}
+
+// Check that prefetched coins are served from the cache and never overwrite cached changes.
+BOOST_AUTO_TEST_CASE(coins_cache_warm_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    uint256 txid = GetRandHash();
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.vout.resize(2);
+    coins.vout[1].nValue = 5;
+    coins.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    size_t nUsage = cache.DynamicMemoryUsage();
+    cache.WarmCoins(txid, coins);
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    BOOST_CHECK(cache.DynamicMemoryUsage() > nUsage);
+    BOOST_CHECK(cache.AccessCoins(txid)->IsAvailable(1));
+
+    cache.ModifyCoins(txid)->Spend(1);
+    CCoins coinsStale;
+    coinsStale.nVersion = 1;
+    coinsStale.vout.resize(2);
+    coinsStale.vout[1].nValue = 5;
+    coinsStale.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    cache.WarmCoins(txid, coinsStale);
+    BOOST_CHECK(!cache.AccessCoins(txid)->IsAvailable(1));
+
+    // Warming alone does not mark an entry for writing
+    uint256 txidOther = GetRandHash();
+    CCoins coinsOther = coinsStale;
+    cache.WarmCoins(txidOther, coinsOther);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoins(txidOther));
+}
+
+// Check that coins handed to the background writer stay visible until they are on disk.
+BOOST_FIXTURE_TEST_CASE(coins_flusher_test, TestingSetup)
+{
+    CCoinsViewDBTest db;
+    CCoinsViewFlusher flusher(&db, &db);
+    boost::thread writer(&CCoinsViewFlusher::ThreadWriter, &flusher);
+
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 10;
+    coins.vout.resize(2);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = i + 1;
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    std::vector<uint256> txids;
+    uint256 hashBlock;
+    for (int nFlush = 0; nFlush < 10; nFlush++) {
+        CCoinsViewCache cache(&flusher);
+        for (unsigned int i = 0; i < 100; i++) {
+            txids.push_back(GetRandHash());
+            *cache.ModifyCoins(txids.back()) = coins;
+        }
+        // Spend an output of a transaction from an earlier flush
+        BOOST_CHECK(cache.ModifyCoins(txids[nFlush])->Spend(0));
+        hashBlock = GetRandHash();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(flusher.GetBestBlock() == hashBlock);
+        BOOST_CHECK(flusher.HaveCoins(txids.back()));
+    }
+    BOOST_CHECK(flusher.Sync());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+
+    CCoins spent = coins;
+    spent.vout[0].SetNull();
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        CCoins read;
+        BOOST_CHECK(db.GetCoins(txids[i], read));
+        BOOST_CHECK(read == (i < 10 ? spent : coins));
+    }
+
+    writer.interrupt();
+    writer.join();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
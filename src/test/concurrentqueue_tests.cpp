@@ -0,0 +1,47 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "concurrentqueue.h"
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(concurrentqueue_tests)
+
+static void Produce(concurrentqueue<int>* queue, int nCount)
+{
+    for (int i = 0; i < nCount; i++)
+        queue->push(i);
+    queue->close();
+}
+
+BOOST_AUTO_TEST_CASE(concurrentqueue_bounded)
+{
+    // A producer far ahead of the consumer waits instead of growing the queue
+    concurrentqueue<int> queue(4);
+    boost::thread producer(Produce, &queue, 1000);
+
+    int nExpected = 0;
+    int n;
+    while (queue.pop(n))
+        BOOST_CHECK_EQUAL(n, nExpected++);
+    BOOST_CHECK_EQUAL(nExpected, 1000);
+    producer.join();
+}
+
+BOOST_AUTO_TEST_CASE(concurrentqueue_close)
+{
+    concurrentqueue<int> queue(1);
+    BOOST_CHECK(queue.push(1));
+    queue.close();
+    BOOST_CHECK(!queue.push(2));
+
+    // Elements queued before closing are still handed out
+    int n = 0;
+    BOOST_CHECK(queue.pop(n));
+    BOOST_CHECK_EQUAL(n, 1);
+    BOOST_CHECK(!queue.pop(n));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "test/test_simplicity.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+namespace
+{
+/** Salted entries are uniform, so any four bytes of them make a hash */
+struct UInt256Hasher {
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, UInt256Hasher> uint256_cache;
+
+uint256 InsecureHash()
+{
+    uint256 hash;
+    for (int i = 0; i < 8; i++) {
+        uint32_t n = insecure_rand();
+        std::memcpy(hash.begin() + 4 * i, &n, 4);
+    }
+    return hash;
+}
+
+/** Fraction of nInserted random entries still found after inserting them in a cache of nBytes */
+double HitRate(size_t nBytes, size_t nInserted)
+{
+    uint256_cache cache;
+    cache.setup_bytes(nBytes);
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nInserted; i++) {
+        vHashes.push_back(InsecureHash());
+        cache.insert(vHashes.back());
+    }
+    size_t nFound = 0;
+    for (const uint256& hash : vHashes)
+        nFound += cache.contains(hash, false);
+    return (double)nFound / nInserted;
+}
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    uint256_cache cache;
+    cache.setup_bytes(32 << 20);
+    for (int i = 0; i < 100000; i++)
+        cache.insert(InsecureHash());
+    for (int i = 0; i < 100000; i++)
+        BOOST_CHECK(!cache.contains(InsecureHash(), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    seed_insecure_rand(true);
+    const size_t nBytes = 1 << 20;
+    const size_t nElements = nBytes / sizeof(uint256);
+    // Below capacity nearly everything is kept, and a full cache keeps most of its entries
+    BOOST_CHECK(HitRate(nBytes, nElements / 2) > 0.99);
+    BOOST_CHECK(HitRate(nBytes, nElements) > 0.85);
+    BOOST_CHECK(HitRate(nBytes, 2 * nElements) > 0.40);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    seed_insecure_rand(true);
+    uint256_cache cache;
+    const size_t nElements = cache.setup_bytes(1 << 20);
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nElements / 2; i++) {
+        vHashes.push_back(InsecureHash());
+        cache.insert(vHashes.back());
+    }
+
+    // Erased entries stay readable until their slot is needed
+    for (size_t i = 0; i < vHashes.size() / 2; i++)
+        BOOST_CHECK(cache.contains(vHashes[i], true));
+    size_t nFound = 0;
+    for (const uint256& hash : vHashes)
+        nFound += cache.contains(hash, false);
+    BOOST_CHECK_EQUAL(nFound, vHashes.size());
+
+    // New entries go to the erased slots first, so the kept half survives
+    for (size_t i = 0; i < nElements / 4; i++)
+        cache.insert(InsecureHash());
+    nFound = 0;
+    for (size_t i = vHashes.size() / 2; i < vHashes.size(); i++)
+        nFound += cache.contains(vHashes[i], false);
+    BOOST_CHECK((double)nFound / (vHashes.size() - vHashes.size() / 2) > 0.95);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent_read)
+{
+    seed_insecure_rand(true);
+    uint256_cache cache;
+    const size_t nElements = cache.setup_bytes(1 << 20);
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nElements / 2; i++) {
+        vHashes.push_back(InsecureHash());
+        cache.insert(vHashes.back());
+    }
+
+    // Readers may erase concurrently as long as nobody inserts
+    const int nThreads = 4;
+    std::vector<size_t> vFound(nThreads, 0);
+    boost::thread_group threadGroup;
+    for (int t = 0; t < nThreads; t++) {
+        threadGroup.create_thread([&, t] {
+            for (size_t i = t; i < vHashes.size(); i += nThreads)
+                vFound[t] += cache.contains(vHashes[i], true);
+        });
+    }
+    threadGroup.join_all();
+    size_t nFound = 0;
+    for (size_t n : vFound)
+        nFound += n;
+    BOOST_CHECK_EQUAL(nFound, vHashes.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,9 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "pow.h"
+#include "random.h"
+#include "txdb.h"
 #include "test_simplicity.h"
 
 #include <boost/test/unit_test.hpp>
@@ -46,4 +49,144 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(unspent_output_without_block_test)
+{
+    // Stakes of pruned blocks are looked up in the coins view instead of the block files
+    LOCK(cs_main);
+    uint256 txid = GetRandHash();
+    {
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(txid);
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.resize(2);
+        coins->vout[1].nValue = 5 * COIN;
+        coins->vout[1].scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    CTxOut out;
+    CBlockIndex* pindexFrom = NULL;
+    BOOST_CHECK(GetUnspentOutput(COutPoint(txid, 1), out, pindexFrom));
+    BOOST_CHECK_EQUAL(out.nValue, 5 * COIN);
+    BOOST_CHECK(pindexFrom == chainActive.Genesis());
+
+    // Spent, missing and out of range outputs are not found
+    BOOST_CHECK(!GetUnspentOutput(COutPoint(txid, 0), out, pindexFrom));
+    BOOST_CHECK(!GetUnspentOutput(COutPoint(txid, 2), out, pindexFrom));
+    BOOST_CHECK(!GetUnspentOutput(COutPoint(GetRandHash(), 0), out, pindexFrom));
+
+    // The stored genesis block counts toward the pruning target
+    BOOST_CHECK(CalculateCurrentUsage() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index_guts_test)
+{
+    // More records than fit in one batch, so several decoder threads take part
+    CBlockTreeDB db(1 << 20, true);
+    std::vector<CBlockIndex> vIndex(3 * BLOCK_INDEX_LOAD_BATCH + 7);
+    std::vector<uint256> vHash(vIndex.size());
+    std::vector<const CBlockIndex*> vBlocks;
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        CBlockIndex& index = vIndex[i];
+        index.nHeight = i;
+        index.nVersion = 2;
+        index.nTime = 1000 + i;
+        index.nBits = (i % 2) ? 0x1e0ffff0 : 0x1d00ffff;
+        index.nTx = 1;
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        vHash[i] = index.GetBlockHeader().GetHash();
+        index.phashBlock = &vHash[i];
+        vBlocks.push_back(&index);
+    }
+    BOOST_CHECK(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks));
+
+    // Start from an empty block index, so that only the loaded entries are in the block index arena
+    LOCK(cs_main);
+    UnloadBlockIndex();
+    BOOST_CHECK(db.LoadBlockIndexGuts());
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        BOOST_REQUIRE(mapBlockIndex.count(vHash[i]));
+        const CBlockIndex* pindex = mapBlockIndex[vHash[i]];
+        BOOST_CHECK_EQUAL(pindex->nHeight, (int)i);
+        BOOST_CHECK_EQUAL(pindex->nTime, 1000 + i);
+        BOOST_CHECK_EQUAL(pindex->nTx, 1U);
+        BOOST_CHECK(pindex->pprev == (i ? mapBlockIndex[vHash[i - 1]] : NULL));
+        // Chain work is only summed up by LoadBlockIndexDB
+        BOOST_CHECK(pindex->nChainWork == GetBlockProof(vIndex[i]));
+    }
+    // Entries cannot be taken out of the arena one by one, so the whole block index goes
+    UnloadBlockIndex();
+    BOOST_CHECK(mapBlockIndex.empty());
+}
+
+BOOST_AUTO_TEST_CASE(block_index_pow_hash_serialization)
+{
+    CDiskBlockIndex index;
+    index.nHeight = 10;
+    index.nTime = 1000;
+    index.nNonce = 42;
+    index.SetProofOfWorkHash(uint256(12345));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << index;
+    CDataStream ssOld(ss);
+    CDiskBlockIndex indexRead;
+    ss >> indexRead;
+    BOOST_CHECK(indexRead.HaveProofOfWorkHash());
+    BOOST_CHECK(indexRead.hashProofOfWork == uint256(12345));
+    BOOST_CHECK_EQUAL(indexRead.nNonce, 42U);
+
+    // A record written back by a version without the hash keeps the status bit only
+    ssOld.resize(ssOld.size() - 32);
+    CDiskBlockIndex indexOld;
+    ssOld >> indexOld;
+    BOOST_CHECK(!indexOld.HaveProofOfWorkHash());
+    BOOST_CHECK_EQUAL(indexOld.nNonce, 42U);
+}
+
+BOOST_AUTO_TEST_CASE(headers_connect_test)
+{
+    // A batch of scrypt² headers on top of the genesis block
+    std::vector<CBlock> headers(3);
+    uint256 hashPrev = chainActive.Genesis()->GetBlockHash();
+    for (CBlock& header : headers) {
+        header.nVersion = ALGO_POW_SCRYPT_SQUARED;
+        header.hashPrevBlock = hashPrev;
+        header.nTime = GetTime();
+        header.nBits = 0;
+        hashPrev = header.GetHash();
+    }
+    BOOST_CHECK(HeadersConnect(headers));
+
+    // Single headers, gaps and unknown parents are left to AcceptBlockHeader
+    BOOST_CHECK(!HeadersConnect(std::vector<CBlock>(headers.begin(), headers.begin() + 1)));
+    BOOST_CHECK(!HeadersConnect(std::vector<CBlock>()));
+    std::vector<CBlock> headersGap;
+    headersGap.push_back(headers[0]);
+    headersGap.push_back(headers[2]);
+    BOOST_CHECK(!HeadersConnect(headersGap));
+    BOOST_CHECK(!HeadersConnect(std::vector<CBlock>(headers.begin() + 1, headers.end())));
+}
+
+BOOST_AUTO_TEST_CASE(headers_proof_of_work_test)
+{
+    std::vector<CBlock> headers(3);
+    uint256 hashPrev = chainActive.Genesis()->GetBlockHash();
+    for (CBlock& header : headers) {
+        header.nVersion = ALGO_POW_SCRYPT_SQUARED;
+        header.hashPrevBlock = hashPrev;
+        header.nTime = chainActive.Genesis()->nTime;
+        header.nBits = 0;
+        hashPrev = header.GetHash();
+    }
+
+    // Old scrypt² headers are only checked when reindexing or verifying
+    BOOST_CHECK(CheckHeadersProofOfWork(headers));
+
+    // A recent header without a valid target fails the batch before anything is hashed
+    for (CBlock& header : headers)
+        header.nTime = GetTime();
+    BOOST_CHECK(!CheckHeadersProofOfWork(headers));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
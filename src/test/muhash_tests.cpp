@@ -0,0 +1,58 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+#include "test/test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(muhash_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(muhash_order_independent)
+{
+    const unsigned char a[] = {1, 2, 3};
+    const unsigned char b[] = {4, 5};
+    const unsigned char c[] = {6};
+
+    CMuHash3072 empty;
+
+    CMuHash3072 ab;
+    ab.Insert(a, sizeof(a));
+    ab.Insert(b, sizeof(b));
+
+    CMuHash3072 ba;
+    ba.Insert(b, sizeof(b));
+    ba.Insert(a, sizeof(a));
+    BOOST_CHECK(ab.GetHash() == ba.GetHash());
+    BOOST_CHECK(ab.GetHash() != empty.GetHash());
+
+    // Removing an element that was never inserted and inserting it later cancels out
+    CMuHash3072 abc;
+    abc.Remove(c, sizeof(c));
+    abc.Insert(a, sizeof(a));
+    abc.Insert(c, sizeof(c));
+    abc.Insert(b, sizeof(b));
+    BOOST_CHECK(abc.GetHash() == ab.GetHash());
+
+    // Normalizing and combining sets keeps the hash
+    abc.Normalize();
+    BOOST_CHECK(abc.GetHash() == ab.GetHash());
+    CMuHash3072 onlyA, onlyB;
+    onlyA.Insert(a, sizeof(a));
+    onlyB.Insert(b, sizeof(b));
+    onlyA *= onlyB;
+    BOOST_CHECK(onlyA.GetHash() == ab.GetHash());
+
+    // Multisets: inserting twice differs from inserting once
+    CMuHash3072 aa;
+    aa.Insert(a, sizeof(a));
+    aa.Insert(a, sizeof(a));
+    BOOST_CHECK(aa.GetHash() != ab.GetHash());
+    aa.Remove(a, sizeof(a));
+    CMuHash3072 justA;
+    justA.Insert(a, sizeof(a));
+    BOOST_CHECK(aa.GetHash() == justA.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -162,6 +162,24 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed_test)
+{
+    seed_insecure_rand(false);
+
+    // Precomputed data gives the same hash for every input, and is ignored for other hash types
+    for (int i = 0; i < 1000; i++) {
+        int nHashType = (i % 2) ? SIGHASH_ALL : insecure_rand();
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, &txdata) == SignatureHash(scriptCode, tx, nIn, nHashType));
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -101,4 +101,35 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+
+    // Enough entries for several chunks; earlier entries must not move
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 10000; i++) {
+        vIndex.push_back(arena.Create());
+        vIndex.back()->nHeight = i;
+        vIndex.back()->pprev = (i == 0) ? NULL : vIndex[i - 1];
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), vIndex.size());
+    BOOST_CHECK(arena.DynamicMemoryUsage() >= vIndex.size() * sizeof(CBlockIndex));
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, i);
+        BOOST_CHECK(vIndex[i]->pprev == (i == 0 ? NULL : vIndex[i - 1]));
+    }
+
+    CBlock block;
+    block.nTime = 1234;
+    CBlockIndex* pindex = arena.Create(block);
+    BOOST_CHECK_EQUAL(pindex->nTime, 1234U);
+    BOOST_CHECK_EQUAL(pindex->nHeight, 0);
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
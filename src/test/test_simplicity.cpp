@@ -32,6 +32,8 @@ BasicTestingSetup::BasicTestingSetup()
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::UNITTEST);
+        InitSignatureCache();
+        InitScriptExecutionCache();
 }
 BasicTestingSetup::~BasicTestingSetup()
 {
@@ -50,6 +52,7 @@ TestingSetup::TestingSetup()
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        zerocoinDB = new CZerocoinDB(0, true);
         InitBlockIndex();
 #ifdef ENABLE_WALLET
         bool fFirstRun;
@@ -75,6 +78,7 @@ TestingSetup::~TestingSetup()
 #endif
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete zerocoinDB;
         delete pcoinsdbview;
         delete pblocktree;
 #ifdef ENABLE_WALLET
@@ -23,7 +23,6 @@ struct BasicTestingSetup {
  * and wallet (if enabled) setup.
  */
 struct TestingSetup: public BasicTestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     boost::filesystem::path pathTemp;
     boost::thread_group threadGroup;
     ECCVerifyHandle globalVerifyHandle;
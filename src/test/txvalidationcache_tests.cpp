@@ -0,0 +1,125 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txvalidationcache_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(scriptexecutioncache_skips_checked_scripts)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    view.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    uint256 hashPrev = GetRandHash();
+    {
+        CCoinsModifier coins = view.ModifyCoins(hashPrev);
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1000;
+        coins->vout[0].scriptPubKey = scriptPubKey;
+    }
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(hashPrev, 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 900;
+    mtx.vout[0].scriptPubKey = scriptPubKey;
+    BOOST_REQUIRE(SignSignature(keystore, scriptPubKey, mtx, 0));
+    CTransaction tx(mtx);
+
+    // Checks handed to the script check threads are not cached
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // A passing inline check is cached for the same flags only
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, false, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // A failing check is not cached
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30);
+    CTransaction txBad(mtx);
+    BOOST_CHECK(!CheckInputs(txBad, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txBad, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(scriptexecutioncache_skips_sighash_precompute)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    view.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    uint256 hashPrev = GetRandHash();
+    {
+        CCoinsModifier coins = view.ModifyCoins(hashPrev);
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.resize(2);
+        for (CTxOut& out : coins->vout) {
+            out.nValue = 1000;
+            out.scriptPubKey = scriptPubKey;
+        }
+    }
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(hashPrev, 0);
+    mtx.vin[1].prevout = COutPoint(hashPrev, 1);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1900;
+    mtx.vout[0].scriptPubKey = scriptPubKey;
+    BOOST_REQUIRE(SignSignature(keystore, scriptPubKey, mtx, 0));
+    BOOST_REQUIRE(SignSignature(keystore, scriptPubKey, mtx, 1));
+    CTransaction tx(mtx);
+
+    // The sighash data of queued checks is built in the storage of the caller
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(2);
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, false, &vChecks, NULL, &vTxData));
+    BOOST_CHECK_EQUAL(vChecks.size(), 2U);
+    BOOST_CHECK_EQUAL(vTxData.size(), 1U);
+    for (CScriptCheck& check : vChecks)
+        BOOST_CHECK(check());
+
+    // Not for a transaction whose scripts are cached
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, false, &vChecks, NULL, &vTxData));
+    BOOST_CHECK(vChecks.empty());
+    BOOST_CHECK_EQUAL(vTxData.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+#include "utxosnapshot.h"
+#include "test/test_simplicity.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_roundtrip)
+{
+    std::vector<uint256> vTxid;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < 10; i++) {
+            vTxid.push_back(GetRandHash());
+            CCoinsModifier coins = pcoinsTip->ModifyCoins(vTxid.back());
+            coins->nVersion = 1;
+            coins->nHeight = 0;
+            coins->vout.resize(2);
+            for (unsigned int n = 0; n < coins->vout.size(); n++) {
+                coins->vout[n].nValue = 1000 * (i + 1) + n;
+                coins->vout[n].scriptPubKey = CScript() << OP_TRUE;
+            }
+        }
+        FlushStateToDisk();
+    }
+    BOOST_CHECK(zerocoinDB->WriteAccumulatorValue(1, CBigNum(7)));
+
+    boost::filesystem::path path = GetDataDir() / "utxo.dat";
+    CSnapshotInfo info;
+    std::string strError;
+    BOOST_CHECK_MESSAGE(DumpUTXOSnapshot(path, info, strError), strError);
+    BOOST_CHECK(info.hashBlock == Params().HashGenesisBlock());
+    BOOST_CHECK_EQUAL(info.nHeight, 0);
+    BOOST_CHECK_EQUAL(info.nBlockIndex, 1U);
+    BOOST_CHECK(info.nCoins >= 2 * vTxid.size());
+    BOOST_CHECK_EQUAL(info.nZerocoin, 1U);
+
+    // Loading happens on a node without outputs
+    {
+        LOCK(cs_main);
+        for (const uint256& txid : vTxid)
+            pcoinsTip->ModifyCoins(txid)->Clear();
+        FlushStateToDisk();
+    }
+
+    // The hash has to be given
+    CSnapshotInfo infoBad;
+    BOOST_CHECK(!LoadUTXOSnapshot(path, 0, infoBad, strError));
+
+    // A damaged record is caught by the hash and the inserted records are removed again
+    boost::filesystem::path pathBad = GetDataDir() / "utxo_bad.dat";
+    boost::filesystem::copy_file(path, pathBad);
+    FILE* file = fopen(pathBad.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, -2, SEEK_END);
+    int ch = fgetc(file);
+    fseek(file, -2, SEEK_END);
+    fputc(ch ^ 1, file);
+    fclose(file);
+    BOOST_CHECK(!LoadUTXOSnapshot(pathBad, info.hashSnapshot, infoBad, strError));
+    BOOST_CHECK(strError.find("snapshot hash mismatch") == 0);
+    {
+        LOCK(cs_main);
+        for (const uint256& txid : vTxid)
+            BOOST_CHECK(!pcoinsTip->HaveCoins(txid));
+    }
+    CBigNum bnValue;
+    BOOST_CHECK(zerocoinDB->ReadAccumulatorValue(1, bnValue));
+    BOOST_CHECK(bnValue == CBigNum(7));
+
+    CSnapshotInfo infoLoaded;
+    BOOST_CHECK_MESSAGE(LoadUTXOSnapshot(path, info.hashSnapshot, infoLoaded, strError), strError);
+    BOOST_CHECK(infoLoaded.hashSnapshot == info.hashSnapshot);
+    BOOST_CHECK(infoLoaded.hashCoins == info.hashCoins);
+    BOOST_CHECK_EQUAL(infoLoaded.nCoins, info.nCoins);
+    BOOST_CHECK_EQUAL(infoLoaded.nZerocoin, info.nZerocoin);
+
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == info.hashBlock);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == info.hashBlock);
+    for (const uint256& txid : vTxid)
+        BOOST_CHECK(pcoinsTip->HaveCoins(txid));
+    // The chain below the snapshot still has to be validated
+    BOOST_CHECK(pindexSnapshotBase == chainActive.Tip());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -87,4 +87,58 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_modexp_engine_tests)
+{
+    CBigNum modulus;
+    modulus.SetHex(strHexModulus);
+    std::shared_ptr<CBigNumModExp> pExp = CBigNumModExp::Get(modulus);
+    BOOST_CHECK(pExp == CBigNumModExp::Get(modulus));
+    BOOST_CHECK(pExp->getModulus() == modulus);
+
+    for (int i = 0; i < 20; i++) {
+        CBigNum base = CBigNum::randBignum(modulus);
+        CBigNum e = CBigNum::randKBitBignum(32 + 50 * i);
+        BOOST_CHECK(pExp->pow_mod(base, e) == base.pow_mod(e, modulus));
+        BOOST_CHECK(pExp->pow_mod(base, CBigNum(0)) == base.pow_mod(CBigNum(0), modulus));
+        if (base.gcd(modulus) == CBigNum(1))
+            BOOST_CHECK(pExp->pow_mod(base, -e) == base.pow_mod(-e, modulus));
+    }
+
+    // Even moduli have no Montgomery form and take the generic path
+    CBigNum even = modulus + 1;
+    CBigNum base = CBigNum::randBignum(even);
+    CBigNum e = CBigNum::randKBitBignum(256);
+    BOOST_CHECK(CBigNumModExp::Get(even)->pow_mod(base, e) == base.pow_mod(e, even));
+}
+
+BOOST_AUTO_TEST_CASE(bignum_fixedbase_tests)
+{
+    CBigNum modulus;
+    modulus.SetHex(strHexModulus);
+    libzerocoin::ZerocoinParams params(modulus);
+
+    for (const libzerocoin::IntegerGroupParams* group : {&params.coinCommitmentGroup, &params.serialNumberSoKCommitmentGroup}) {
+        CBigNumFixedBase fixedH(group->h, group->modulus, group->groupOrder);
+        for (int i = 0; i < 20; i++) {
+            CBigNum e = CBigNum::randBignum(group->groupOrder);
+            BOOST_CHECK(group->powG(e) == group->g.pow_mod(e, group->modulus));
+            BOOST_CHECK(fixedH.pow_mod(e) == group->h.pow_mod(e, group->modulus));
+
+            // Exponents outside [0, order) are reduced, which leaves the power unchanged
+            CBigNum eLong = e + group->groupOrder * CBigNum::randKBitBignum(64);
+            BOOST_CHECK(group->powH(eLong) == group->h.pow_mod(eLong, group->modulus));
+            BOOST_CHECK(group->powG(-e) == CBigNumModExp::Get(group->modulus)->pow_mod(group->g, -e));
+        }
+        BOOST_CHECK(group->powG(CBigNum(0)) == CBigNum(1));
+    }
+
+    // A deserialized group has no tables and takes the generic path
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << params.coinCommitmentGroup;
+    libzerocoin::IntegerGroupParams group;
+    ss >> group;
+    CBigNum e = CBigNum::randBignum(group.groupOrder);
+    BOOST_CHECK(group.powG(e) == params.coinCommitmentGroup.powG(e));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -518,4 +518,34 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99)
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(denomination_index_test)
+{
+    for (unsigned int i = 0; i < libzerocoin::zerocoinDenomList.size(); i++)
+        BOOST_CHECK_EQUAL(libzerocoin::ZerocoinDenominationToIndex(libzerocoin::zerocoinDenomList[i]), (int)i);
+    BOOST_CHECK_EQUAL(libzerocoin::zerocoinDenomList.size(), libzerocoin::ZEROCOIN_DENOM_COUNT);
+    BOOST_CHECK_EQUAL(libzerocoin::ZerocoinDenominationToIndex(libzerocoin::ZQ_ERROR), -1);
+
+    // Block index entries count mints and supply per denomination
+    CBlockIndex index;
+    BOOST_CHECK(!index.HasMints());
+    index.AddMint(libzerocoin::ZQ_TEN);
+    index.AddMint(libzerocoin::ZQ_TEN);
+    index.AddMint(libzerocoin::ZQ_FIVE_THOUSAND);
+    BOOST_CHECK(index.HasMints());
+    BOOST_CHECK_EQUAL(index.GetMintCount(libzerocoin::ZQ_TEN), 2U);
+    BOOST_CHECK_EQUAL(index.GetMintCount(libzerocoin::ZQ_FIVE_THOUSAND), 1U);
+    BOOST_CHECK(index.MintedDenomination(libzerocoin::ZQ_TEN));
+    BOOST_CHECK(!index.MintedDenomination(libzerocoin::ZQ_ONE));
+
+    index.SetZcMints(libzerocoin::ZQ_TEN, 3);
+    index.AddZcMints(libzerocoin::ZQ_TEN, -1);
+    index.AddZcMints(libzerocoin::ZQ_ONE, 4);
+    BOOST_CHECK_EQUAL(index.GetZcMints(libzerocoin::ZQ_TEN), 2);
+    BOOST_CHECK_EQUAL(index.GetZerocoinSupply(), 2 * 10 * COIN + 4 * COIN);
+    BOOST_CHECK_THROW(index.GetZcMints(libzerocoin::ZQ_ERROR), std::out_of_range);
+
+    index.ClearMints();
+    BOOST_CHECK(!index.HasMints());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <zspl/accumulators.h>
 #include "wallet/wallet.h"
+#include "zspl/witness.h"
 #include "zspl/zsplwallet.h"
 #include "zsplchain.h"
 #include "test_simplicity.h"
@@ -456,6 +457,197 @@ BOOST_AUTO_TEST_CASE(checksum_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(block_pubcoins_index_test)
+{
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    listPubcoins.emplace_back(params, CBigNum(101), libzerocoin::ZQ_TEN);
+    listPubcoins.emplace_back(params, CBigNum(103), libzerocoin::ZQ_ONE);
+    listPubcoins.emplace_back(params, CBigNum(107), libzerocoin::ZQ_TEN);
+
+    uint256 hashBlock = GetRandHash();
+    CBlockIndex index;
+    index.nHeight = 1234;
+    index.phashBlock = &hashBlock;
+    BOOST_CHECK(zerocoinDB->WriteBlockPubcoins(&index, listPubcoins));
+
+    std::list<libzerocoin::PublicCoin> listRead;
+    BOOST_CHECK(zerocoinDB->ReadBlockPubcoins(&index, listRead));
+    BOOST_CHECK_EQUAL(listRead.size(), listPubcoins.size());
+    std::list<libzerocoin::PublicCoin>::const_iterator it = listPubcoins.begin();
+    for (const libzerocoin::PublicCoin& pubcoin : listRead) {
+        BOOST_CHECK(pubcoin.getValue() == it->getValue());
+        BOOST_CHECK_EQUAL(pubcoin.getDenomination(), it->getDenomination());
+        ++it;
+    }
+
+    // a different block at the same height does not see the record
+    uint256 hashOther = GetRandHash();
+    CBlockIndex indexOther;
+    indexOther.nHeight = index.nHeight;
+    indexOther.phashBlock = &hashOther;
+    listRead.clear();
+    BOOST_CHECK(!zerocoinDB->ReadBlockPubcoins(&indexOther, listRead));
+
+    BOOST_CHECK(zerocoinDB->EraseBlockPubcoins(index.nHeight));
+    BOOST_CHECK(!zerocoinDB->ReadBlockPubcoins(&index, listRead));
+    BOOST_CHECK(listRead.empty());
+}
+
+BOOST_AUTO_TEST_CASE(witness_cache_roundtrip_test)
+{
+    CoinWitnessCacheData data;
+    data.denom = libzerocoin::ZQ_FIFTY;
+    data.isV1 = false;
+    data.nHeightMintAdded = 1005;
+    data.nHeightAccStart = 1000;
+    data.nHeightCheckpoint = 1010;
+    data.nHeightAccEnd = 1239;
+    data.hashBlockAccEnd = GetRandHash();
+    data.nMintsAdded = 12;
+    data.coinAmount = CBigNum(1234567);
+    data.coinDenom = libzerocoin::ZQ_FIFTY;
+    data.accumulatorAmount = CBigNum(7654321);
+    data.accumulatorDenom = libzerocoin::ZQ_FIFTY;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << data;
+    CoinWitnessCacheData dataRead;
+    ss >> dataRead;
+
+    // the persisted witness continues from where it was accumulated to
+    CoinWitnessData witness(dataRead);
+    BOOST_CHECK_EQUAL(witness.nHeightAccEnd, data.nHeightAccEnd);
+    BOOST_CHECK(witness.hashBlockAccEnd == data.hashBlockAccEnd);
+    BOOST_CHECK_EQUAL(witness.nMintsAdded, data.nMintsAdded);
+    BOOST_CHECK(witness.coin->getValue() == data.coinAmount);
+    BOOST_CHECK(witness.pAccumulator->getValue() == data.accumulatorAmount);
+
+    CoinWitnessCacheData dataAgain(&witness);
+    BOOST_CHECK(dataAgain.hashBlockAccEnd == data.hashBlockAccEnd);
+    BOOST_CHECK(dataAgain.accumulatorAmount == data.accumulatorAmount);
+}
+
+BOOST_AUTO_TEST_CASE(accumulator_batch_test)
+{
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    std::vector<CBigNum> vValues;
+    for (int i = 0; i < 2 * ACCUMULATOR_BATCH_SIZE + 3; i++) {
+        CBigNum bnValue = CBigNum::randKBitBignum(1024);
+        libzerocoin::CoinDenomination denom = (i % 3) ? libzerocoin::ZQ_ONE : libzerocoin::ZQ_FIVE;
+        listPubcoins.emplace_back(params, bnValue, denom);
+        if (denom == libzerocoin::ZQ_ONE)
+            vValues.push_back(bnValue);
+    }
+
+    // the batch raises the accumulator to the same product as one increment per value
+    libzerocoin::Accumulator accSingle(params, libzerocoin::ZQ_ONE);
+    libzerocoin::Accumulator accBatch(params, libzerocoin::ZQ_ONE);
+    for (const CBigNum& bnValue : vValues)
+        accSingle.increment(bnValue);
+    accBatch.incrementBatch(vValues);
+    BOOST_CHECK(accSingle.getValue() == accBatch.getValue());
+
+    AccumulatorMap mapSingle(params);
+    AccumulatorMap mapBatch(params);
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        BOOST_CHECK(mapSingle.Accumulate(pubcoin, true));
+    BOOST_CHECK(mapBatch.AccumulateBatch(listPubcoins));
+    BOOST_CHECK(mapSingle.GetCheckpoint() == mapBatch.GetCheckpoint());
+    BOOST_CHECK(mapBatch.GetValue(libzerocoin::ZQ_ONE) == accBatch.getValue());
+
+    std::vector<CBigNum> vEmpty;
+    accBatch.incrementBatch(vEmpty);
+    BOOST_CHECK(accSingle.getValue() == accBatch.getValue());
+}
+
+BOOST_AUTO_TEST_CASE(accumulator_batch_denominations_test)
+{
+    // mints of every denomination, interleaved, so each of them gets its own worker
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    std::list<libzerocoin::PublicCoin> listFirst;
+    std::list<libzerocoin::PublicCoin> listSecond;
+    for (int i = 0; i < 3; i++) {
+        for (const libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList) {
+            listFirst.emplace_back(params, CBigNum::randKBitBignum(1024), denom);
+            listSecond.emplace_back(params, CBigNum::randKBitBignum(1024), denom);
+        }
+    }
+
+    // two batches in a row end up where incrementing the coins one at a time does
+    AccumulatorMap mapSingle(params);
+    AccumulatorMap mapBatch(params);
+    for (const libzerocoin::PublicCoin& pubcoin : listFirst)
+        BOOST_CHECK(mapSingle.Accumulate(pubcoin, true));
+    for (const libzerocoin::PublicCoin& pubcoin : listSecond)
+        BOOST_CHECK(mapSingle.Accumulate(pubcoin, true));
+    BOOST_CHECK(mapBatch.AccumulateBatch(listFirst));
+    BOOST_CHECK(mapBatch.AccumulateBatch(listSecond));
+    for (const libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList)
+        BOOST_CHECK(mapSingle.GetValue(denom) == mapBatch.GetValue(denom));
+    BOOST_CHECK(mapSingle.GetCheckpoint() == mapBatch.GetCheckpoint());
+
+    // an empty range leaves the accumulators as they are
+    BOOST_CHECK(mapBatch.AccumulateBatch(std::list<libzerocoin::PublicCoin>()));
+    BOOST_CHECK(mapSingle.GetCheckpoint() == mapBatch.GetCheckpoint());
+}
+
+BOOST_AUTO_TEST_CASE(accumulator_range_cache_test)
+{
+    CAccumulatorRangeCache cache(3);
+    CBigNum bnBase(5), bnOtherBase(7);
+    uint256 hashBlock = GetRandHash();
+    cache.Add(libzerocoin::ZQ_ONE, 100, 200, bnBase, CBigNum(11), hashBlock, 4);
+    cache.Add(libzerocoin::ZQ_ONE, 100, 300, bnBase, CBigNum(13), hashBlock, 6);
+    cache.Add(libzerocoin::ZQ_FIVE, 100, 400, bnBase, CBigNum(17), hashBlock, 8);
+
+    // the longest range of the denomination and base that does not go past the limit
+    int nHeightTo = 0, nMints = 0;
+    CBigNum bnValue;
+    uint256 hashBlockTo;
+    BOOST_CHECK(cache.GetLongest(libzerocoin::ZQ_ONE, 100, 350, bnBase, nHeightTo, bnValue, hashBlockTo, nMints));
+    BOOST_CHECK_EQUAL(nHeightTo, 300);
+    BOOST_CHECK(bnValue == CBigNum(13));
+    BOOST_CHECK_EQUAL(nMints, 6);
+    BOOST_CHECK(hashBlockTo == hashBlock);
+    BOOST_CHECK(cache.GetLongest(libzerocoin::ZQ_ONE, 100, 299, bnBase, nHeightTo, bnValue, hashBlockTo, nMints));
+    BOOST_CHECK_EQUAL(nHeightTo, 200);
+    BOOST_CHECK(!cache.GetLongest(libzerocoin::ZQ_ONE, 100, 199, bnBase, nHeightTo, bnValue, hashBlockTo, nMints));
+    BOOST_CHECK(!cache.GetLongest(libzerocoin::ZQ_ONE, 100, 350, bnOtherBase, nHeightTo, bnValue, hashBlockTo, nMints));
+    BOOST_CHECK(!cache.GetLongest(libzerocoin::ZQ_ONE, 101, 350, bnBase, nHeightTo, bnValue, hashBlockTo, nMints));
+
+    // the oldest range is evicted once the cache is full
+    cache.Add(libzerocoin::ZQ_ONE, 100, 250, bnBase, CBigNum(19), hashBlock, 5);
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+    BOOST_CHECK(cache.GetLongest(libzerocoin::ZQ_ONE, 100, 299, bnBase, nHeightTo, bnValue, hashBlockTo, nMints));
+    BOOST_CHECK_EQUAL(nHeightTo, 250);
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mintpool_count_index_test)
+{
+    CMintPool mintPool;
+    uint256 hashFirst = GetRandHash();
+    uint256 hashSecond = GetRandHash();
+    mintPool.Add(std::make_pair(hashFirst, 7));
+    mintPool.Add(std::make_pair(hashSecond, 8));
+    BOOST_CHECK(mintPool.HasCount(7));
+    BOOST_CHECK(mintPool.HasCount(8));
+    BOOST_CHECK(!mintPool.HasCount(9));
+    BOOST_CHECK_EQUAL(mintPool.CountOfLastGenerated(), 8U);
+
+    // a removed count is generated again
+    mintPool.Remove(hashFirst);
+    BOOST_CHECK(!mintPool.HasCount(7));
+    BOOST_CHECK_EQUAL(mintPool.CountOfLastRemoved(), 7U);
+
+    mintPool.Reset();
+    BOOST_CHECK(!mintPool.HasCount(8));
+    BOOST_CHECK(mintPool.empty());
+}
+
 BOOST_AUTO_TEST_CASE(test_checkpoints)
 {
     BOOST_CHECK_MESSAGE(AccumulatorCheckpoints::LoadCheckpoints("main"), "failed to load checkpoints");
@@ -109,6 +109,17 @@ BOOST_AUTO_TEST_CASE(zerocoin_public_spend_test)
     BOOST_CHECK_MESSAGE(publicSpendTest.HasValidSignature(), "Failed to validate public spend signature");
     BOOST_CHECK_MESSAGE(spend->HasValidSignature(), "Failed to validate spend signature");
 
+    // Deferred to a check, the signature is verified by the check only
+    std::shared_ptr<PublicCoinSpend> deferredSpend = std::make_shared<PublicCoinSpend>(ZCParams);
+    BOOST_CHECK(ZSPLModule::validateInput(in, out, tx, *deferredSpend, false));
+    BOOST_CHECK_MESSAGE(CZerocoinSpendCheck(deferredSpend, NULL, tx.GetHash())(), "Failed to check deferred public spend");
+
+    CMutableTransaction txOther(tx);
+    txOther.vout[0].nValue = 2*CENT;
+    std::shared_ptr<PublicCoinSpend> otherSpend = std::make_shared<PublicCoinSpend>(ZCParams);
+    BOOST_CHECK(ZSPLModule::validateInput(in, out, txOther, *otherSpend, false));
+    BOOST_CHECK_MESSAGE(!CZerocoinSpendCheck(otherSpend, NULL, txOther.GetHash())(), "Signature over other outputs");
+
     // Verify that fails with a different denomination
     in.nSequence = 500;
     PublicCoinSpend publicSpend2(ZCParams);
@@ -7,22 +7,149 @@
 
 #include "txdb.h"
 
+#include "guiinterface.h"
+#include "init.h"
 #include "main.h"
+#include "muhash.h"
+#include "orderedpipeline.h"
 #include "pow.h"
 #include "uint256.h"
 #include "zspl/accumulators.h"
 
+#include <atomic>
+#include <memory>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+/**
+ * Key of a single unspent output in the chainstate: 'C' + txid + VARINT(n).
+ * All outputs of a transaction share the 'C' + txid prefix, so they can be
+ * read back together with one seek.
+ */
+class CCoinsOutputKey
 {
-    if (coins.IsPruned())
-        batch.Erase(std::make_pair('c', hash));
-    else
-        batch.Write(std::make_pair('c', hash), coins);
+public:
+    uint256 txid;
+    uint32_t n;
+
+    CCoinsOutputKey(const uint256& txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        char chType = 'C';
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Value of a single unspent output in the chainstate. The transaction
+ * metadata is repeated in every output record of the transaction:
+ * - VARINT(nVersion)
+ * - VARINT(nCode), nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+class CCoinsOutputRecord
+{
+public:
+    int nVersion;
+    int nHeight;
+    bool fCoinBase;
+    bool fCoinStake;
+    CTxOut txout;
+
+    CCoinsOutputRecord() : nVersion(0), nHeight(0), fCoinBase(false), fCoinStake(false) {}
+    CCoinsOutputRecord(const CCoins& coins, unsigned int n) : nVersion(coins.nVersion), nHeight(coins.nHeight),
+                                                              fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake), txout(coins.vout[n]) {}
+
+    //! Merge this output and the transaction metadata into coins
+    void ApplyTo(CCoins& coins, unsigned int n) const
+    {
+        coins.nVersion = nVersion;
+        coins.nHeight = nHeight;
+        coins.fCoinBase = fCoinBase;
+        coins.fCoinStake = fCoinStake;
+        if (coins.vout.size() <= n)
+            coins.vout.resize(n + 1);
+        coins.vout[n] = txout;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn)
+    {
+        unsigned int nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nVersion));
+        READWRITE(VARINT(nCode));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 4;
+            fCoinStake = (nCode & 2) != 0;
+            fCoinBase = (nCode & 1) != 0;
+        }
+        READWRITE(REF(CTxOutCompressor(txout)));
+    }
+};
+
+/**
+ * Running totals and set hash of the output records in the chainstate,
+ * stored under 'S'. They are updated from the same record differences
+ * that are written to disk and go into the same batch as the best block,
+ * so they always describe exactly the coins on disk.
+ */
+class CCoinsSetStats
+{
+public:
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    CMuHash3072 muhash;
+
+    CCoinsSetStats() : nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    void AddOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue, CAmount nValue)
+    {
+        nTransactionOutputs++;
+        nSerializedSize += slKey.size() + slValue.size();
+        nTotalAmount += nValue;
+        const std::string strElement = slKey.ToString() + slValue.ToString();
+        muhash.Insert((const unsigned char*)strElement.data(), strElement.size());
+    }
+
+    void RemoveOutput(const leveldb::Slice& slKey, const leveldb::Slice& slValue, CAmount nValue)
+    {
+        nTransactionOutputs--;
+        nSerializedSize -= slKey.size() + slValue.size();
+        nTotalAmount -= nValue;
+        const std::string strElement = slKey.ToString() + slValue.ToString();
+        muhash.Remove((const unsigned char*)strElement.data(), strElement.size());
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nSerializedSize));
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+static std::string CoinsPrefix(const uint256& txid)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << std::make_pair('C', txid);
+    return ssPrefix.str();
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
@@ -34,14 +161,42 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+CCoinsViewDB::CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : db(path, nCacheSize, fMemory, fWipe)
+{
+}
+
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(std::make_pair('c', txid), coins);
+    const std::string strPrefix = CoinsPrefix(txid);
+    leveldb::Slice slPrefix(strPrefix);
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    coins.Clear();
+    bool fFound = false;
+    for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data() + slPrefix.size(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        uint32_t n;
+        ssKey >> VARINT(n);
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        CCoinsOutputRecord record;
+        ssValue >> record;
+        record.ApplyTo(coins, n);
+        fFound = true;
+    }
+    HandleError(pcursor->status());
+    return fFound;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(std::make_pair('c', txid));
+    const std::string strPrefix = CoinsPrefix(txid);
+    leveldb::Slice slPrefix(strPrefix);
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(slPrefix);
+    return pcursor->Valid() && pcursor->key().starts_with(slPrefix);
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -52,27 +207,353 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
+/**
+ * Queue the difference between coins and the output records of txid on disk.
+ * Unchanged outputs are neither rewritten nor re-serialized into the batch;
+ * fFresh entries are known to have no records on disk, so the lookup is skipped.
+ * Every record that is erased, replaced or added is also applied to stats.
+ */
+void CCoinsViewDB::BatchWriteCoins(CLevelDBBatch& batch, leveldb::Iterator* pcursor, const uint256& txid, const CCoins& coins, bool fFresh, CCoinsSetStats& stats, size_t& nWritten, size_t& nErased) const
+{
+    std::vector<bool> vOnDisk(coins.vout.size(), false);
+    bool fHadRecords = false;
+    if (!fFresh) {
+        const std::string strPrefix = CoinsPrefix(txid);
+        leveldb::Slice slPrefix(strPrefix);
+        for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+            fHadRecords = true;
+            leveldb::Slice slKey = pcursor->key();
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssKey(slKey.data() + slPrefix.size(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            uint32_t n;
+            ssKey >> VARINT(n);
+            if (n < coins.vout.size() && !coins.vout[n].IsNull()) {
+                CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                ssValue << CCoinsOutputRecord(coins, n);
+                // Outputs that are already on disk unchanged need no write
+                vOnDisk[n] = slValue == leveldb::Slice(&ssValue[0], ssValue.size());
+                if (vOnDisk[n])
+                    continue;
+            }
+            CDataStream ssOld(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsOutputRecord recordOld;
+            ssOld >> recordOld;
+            stats.RemoveOutput(slKey, slValue, recordOld.txout.nValue);
+            if (n >= coins.vout.size() || coins.vout[n].IsNull()) {
+                batch.Erase(CCoinsOutputKey(txid, n));
+                nErased++;
+            }
+        }
+        HandleError(pcursor->status());
+    }
+
+    for (unsigned int n = 0; n < coins.vout.size(); n++) {
+        if (coins.vout[n].IsNull() || vOnDisk[n])
+            continue;
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << CCoinsOutputKey(txid, n);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << CCoinsOutputRecord(coins, n);
+        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+        leveldb::Slice slValue(&ssValue[0], ssValue.size());
+        batch.WriteRaw(slKey, slValue);
+        stats.AddOutput(slKey, slValue, coins.vout[n].nValue);
+        nWritten++;
+    }
+
+    if (fHadRecords)
+        stats.nTransactions--;
+    if (!coins.IsPruned())
+        stats.nTransactions++;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    bool fOk = WriteCoins(mapCoins, hashBlock);
+    mapCoins.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CCoinsSetStats stats;
+    db.Read('S', stats);
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t written = 0;
+    size_t erased = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            BatchWriteCoins(batch, pcursor.get(), it->first, it->second.coins, it->second.flags & CCoinsCacheEntry::FRESH, stats, written, erased);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    }
+    // The statistics and the best block go into the same atomic batch, after the coins they describe
+    if (changed) {
+        stats.muhash.Normalize();
+        batch.Write('S', stats);
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database: %u outputs written, %u erased...\n",
+        (unsigned int)changed, (unsigned int)count, (unsigned int)written, (unsigned int)erased);
     return db.WriteBatch(batch);
 }
 
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView* viewIn, CCoinsViewDB* dbIn) : CCoinsViewBacked(viewIn), db(dbIn),
+                                                                             mapPending(0, CCoinsKeyHasher(), std::equal_to<uint256>(), CCoinsMapAllocator(&resourcePending)),
+                                                                             fPending(false), fWriterRunning(false), fFailed(false)
+{
+}
+
+bool CCoinsViewFlusher::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewFlusher::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end())
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fPending && hashBlockPending != uint256(0))
+            return hashBlockPending;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    // The previous batch must be on disk before the next one can be diffed against it
+    if (!Sync())
+        return false;
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (!fWriterRunning) {
+        lock.unlock();
+        return base->BatchWrite(mapCoins, hashBlock);
+    }
+
+    size_t nCount = 0;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapPending[it->first];
+            entry.coins.swap(it->second.coins);
+            entry.flags = it->second.flags;
+            nCount++;
+        }
+        CCoinsMap::iterator itOld = it++;
+        mapCoins.erase(itOld);
+    }
+    hashBlockPending = hashBlock;
+    fPending = true;
+    condPending.notify_one();
+    LogPrint("coindb", "Handed %u changed transactions to the background coin writer\n", (unsigned int)nCount);
+    return true;
+}
+
+bool CCoinsViewFlusher::GetStats(CCoinsStats& stats) const
+{
+    if (!const_cast<CCoinsViewFlusher*>(this)->Sync())
+        return false;
+    return base->GetStats(stats);
+}
+
+bool CCoinsViewFlusher::WritePending()
+{
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    std::string strError;
+    try {
+        // mapPending is only read here, so readers holding cs can keep using it meanwhile
+        fOk = db->WriteCoins(mapPending, hashBlockPending);
+        if (!fOk)
+            strError = "write failed";
+    } catch (const std::exception& e) {
+        strError = e.what();
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fOk) {
+        CCoinsMap(0, mapPending.hash_function(), mapPending.key_eq(), mapPending.get_allocator()).swap(mapPending);
+        resourcePending.Release();
+        fPending = false;
+        LogPrint("bench", "    - Background coin write: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    } else {
+        // Keep the batch so reads stay correct; the next flush reports the failure
+        fFailed = true;
+        strFailure = strError;
+        LogPrintf("%s : failed to write coin database: %s\n", __func__, strError);
+    }
+    condDone.notify_all();
+    return fOk;
+}
+
+bool CCoinsViewFlusher::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (fPending && fWriterRunning && !fFailed)
+        condDone.wait(lock);
+    if (fFailed)
+        return error("%s : background coin write failed: %s", __func__, strFailure);
+    if (!fPending)
+        return true;
+    // The writer thread is gone (shutdown) and left a batch behind
+    lock.unlock();
+    return WritePending();
+}
+
+void CCoinsViewFlusher::ThreadWriter()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fWriterRunning = true;
+    }
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fPending || fFailed)
+                    condPending.wait(lock);
+            }
+            WritePending();
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fWriterRunning = false;
+        condDone.notify_all();
+        throw;
+    }
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('c', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key()[0] != 'c')
+        return db.Exists('S') || RebuildStats();
+
+    LogPrintf("Upgrading chainstate database to per-outpoint records...\n");
+    uiInterface.InitMessage(_("Upgrading coin database..."));
+
+    CLevelDBBatch batch;
+    size_t nBatchOutputs = 0;
+    size_t nTransactions = 0;
+    size_t nOutputs = 0;
+    int nReportedDone = -1;
+    while (pcursor->Valid()) {
+        if (ShutdownRequested())
+            break;
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            uint256 txid;
+            ssKey >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                if (coins.vout[n].IsNull())
+                    continue;
+                batch.Write(CCoinsOutputKey(txid, n), CCoinsOutputRecord(coins, n));
+                nBatchOutputs++;
+                nOutputs++;
+            }
+            batch.Erase(std::make_pair('c', txid));
+            nTransactions++;
+
+            if (nBatchOutputs >= COINS_UPGRADE_BATCH_OUTPUTS) {
+                if (!db.WriteBatch(batch))
+                    return error("%s : failed to write batch", __func__);
+                batch.Clear();
+                nBatchOutputs = 0;
+                // Keys are ordered by txid, so its first byte tells how far along we are
+                int nDone = (int)*txid.begin() * 100 / 256;
+                if (nDone != nReportedDone) {
+                    uiInterface.InitMessage(strprintf(_("Upgrading coin database... (%d%%)"), nDone));
+                    nReportedDone = nDone;
+                }
+            }
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s : failed to write batch", __func__);
+
+    LogPrintf("Upgraded %u transactions (%u unspent outputs) in the chainstate database%s\n",
+        nTransactions, nOutputs, ShutdownRequested() ? ", interrupted" : "");
+    return !ShutdownRequested() && RebuildStats();
+}
+
+bool CCoinsViewDB::RebuildStats()
+{
+    LogPrintf("Computing chainstate statistics...\n");
+    uiInterface.InitMessage(_("Computing coin database statistics..."));
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CCoinsSetStats stats;
+    uint256 txidPrev;
+    for (pcursor->Seek("C"); pcursor->Valid() && pcursor->key().starts_with("C"); pcursor->Next()) {
+        if (ShutdownRequested())
+            return false;
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsOutputRecord record;
+            ssValue >> record;
+            // Output records of a transaction are adjacent
+            if (stats.nTransactionOutputs == 0 || txid != txidPrev)
+                stats.nTransactions++;
+            txidPrev = txid;
+            stats.AddOutput(slKey, slValue, record.txout.nValue);
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    HandleError(pcursor->status());
+
+    stats.muhash.Normalize();
+    LogPrintf("Chainstate holds %u unspent outputs of %u transactions\n", stats.nTransactionOutputs, stats.nTransactions);
+    return db.Write('S', stats, true);
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
 }
@@ -108,55 +589,17 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    CCoinsSetStats setstats;
+    if (!db.Read('S', setstats))
+        return false;
     stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
-            pcursor->Next();
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        }
-    }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+    stats.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
+    stats.nTransactions = setstats.nTransactions;
+    stats.nTransactionOutputs = setstats.nTransactionOutputs;
+    stats.nSerializedSize = setstats.nSerializedSize;
+    stats.hashSerialized = setstats.muhash.GetHash();
+    stats.nTotalAmount = setstats.nTotalAmount;
     return true;
 }
 
@@ -209,16 +652,207 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::WriteStakeCoinAge(const uint256& hashBlock, uint64_t nCoinAge)
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    return Write(std::make_pair('a', hashBlock), nCoinAge);
+}
+
+bool CBlockTreeDB::ReadStakeCoinAge(const uint256& hashBlock, uint64_t& nCoinAge)
+{
+    return Read(std::make_pair('a', hashBlock), nCoinAge);
+}
 
+bool CBlockTreeDB::WriteSnapshotBase(const uint256& hashBlock, const uint256& hashCoins)
+{
+    return Write('U', std::make_pair(hashBlock, hashCoins), true);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256& hashBlock, uint256& hashCoins)
+{
+    std::pair<uint256, uint256> base;
+    if (!Read('U', base))
+        return false;
+    hashBlock = base.first;
+    hashCoins = base.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseSnapshotBase()
+{
+    return Erase('U', true);
+}
+
+namespace
+{
+/** A run of consecutive block index records, as read from the cursor and once decoded */
+struct CBlockIndexBatch {
+    std::vector<std::string> vValues;
+    std::vector<CDiskBlockIndex> vIndex;
+    std::vector<uint256> vHash;
+    std::string strError;
+};
+typedef COrderedPipeline<CBlockIndexBatch> CBlockIndexLoader;
+
+/** Reader stage of the block index loading: copy the raw 'b' records out of the cursor */
+void ReadBlockIndexRecords(leveldb::Iterator* pcursor, CBlockIndexLoader& loader, std::atomic<int64_t>& nTimeRead)
+{
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << std::make_pair('b', uint256(0));
+    int64_t nStart = GetTimeMicros();
     pcursor->Seek(ssKeySet.str());
 
+    std::shared_ptr<CBlockIndexBatch> batch = std::make_shared<CBlockIndexBatch>();
+    batch->vValues.reserve(BLOCK_INDEX_LOAD_BATCH);
+    while (true) {
+        bool fEnd = !pcursor->Valid() || pcursor->key().empty() || pcursor->key()[0] != 'b';
+        if (!fEnd) {
+            batch->vValues.push_back(pcursor->value().ToString());
+            pcursor->Next();
+        }
+        if (batch->vValues.size() == BLOCK_INDEX_LOAD_BATCH || (fEnd && !batch->vValues.empty())) {
+            nTimeRead += GetTimeMicros() - nStart;
+            if (!loader.Push(batch))
+                break;
+            nStart = GetTimeMicros();
+            batch = std::make_shared<CBlockIndexBatch>();
+            batch->vValues.reserve(BLOCK_INDEX_LOAD_BATCH);
+        }
+        if (fEnd)
+            break;
+    }
+    if (!pcursor->status().ok())
+        throw std::runtime_error(pcursor->status().ToString());
+}
+
+/** Decoder stage of the block index loading: deserialize the records, hash the headers and check their proof of work */
+void DecodeBlockIndexRecords(CBlockIndexBatch& batch, std::atomic<int64_t>& nTimeDecode)
+{
+    int64_t nStart = GetTimeMicros();
+    try {
+        batch.vIndex.resize(batch.vValues.size());
+        batch.vHash.resize(batch.vValues.size());
+        for (size_t i = 0; i < batch.vValues.size(); i++) {
+            CDataStream ssValue(batch.vValues[i].data(), batch.vValues[i].data() + batch.vValues[i].size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex& diskindex = batch.vIndex[i];
+            ssValue >> diskindex;
+            CBlockHeader header = diskindex.GetBlockHeader();
+            batch.vHash[i] = header.GetHash();
+            // The division in GetBlockProof is the costly part of the chain work, so it is done here
+            diskindex.nChainWork = GetBlockProof(diskindex);
+
+            // treat PoW and PoS blocks the same - don't waste time on redundant PoW checks that won't catch invalid PoS blocks anyway - nNonce = 0 for PoS blocks
+            if ((diskindex.nNonce != 0 || diskindex.nVersion >= Params().WALLET_UPGRADE_VERSION()) && diskindex.IsProofOfWork() && CBlockHeader::GetAlgo(diskindex.nVersion) != POW_SCRYPT_SQUARED) {
+                if (!CheckProofOfWork(&header)) {
+                    batch.strError = strprintf("CheckProofOfWork failed: height=%d hash=%s", diskindex.nHeight, batch.vHash[i].ToString());
+                    break;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        batch.strError = strprintf("Deserialize or I/O error - %s", e.what());
+    }
+    std::vector<std::string>().swap(batch.vValues);
+    nTimeDecode += GetTimeMicros() - nStart;
+}
+} // anon namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    int64_t nStart = GetTimeMicros();
+    int64_t nTimeLink = 0;
+    size_t nEntries = 0;
+    // Time spent per stage, summed over the threads of the stage
+    std::atomic<int64_t> nTimeRead(0);
+    std::atomic<int64_t> nTimeDecode(0);
+    // A reader thread copies the records out of the cursor, decoder threads deserialize them,
+    // and this thread links the entries into mapBlockIndex in key order
+    CBlockIndexLoader loader(MAX_BLOCK_INDEX_LOAD_QUEUE);
+    loader.Start("idx", [&](CBlockIndexLoader& l) { ReadBlockIndexRecords(pcursor.get(), l, nTimeRead); },
+        [&](CBlockIndexBatch& b) { DecodeBlockIndexRecords(b, nTimeDecode); }, nThreads);
+
     // Load mapBlockIndex
     uint256 nPreviousCheckpoint;
+    std::shared_ptr<CBlockIndexBatch> batch;
+    while (loader.Next(batch)) {
+        boost::this_thread::interruption_point();
+        if (!batch->strError.empty())
+            return error("LoadBlockIndex() : %s", batch->strError);
+
+        int64_t nStartLink = GetTimeMicros();
+        for (size_t i = 0; i < batch->vIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = batch->vIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(batch->vHash[i]);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+            // Only the work of this block, LoadBlockIndexDB adds that of its ancestors
+            pindexNew->nChainWork = diskindex.nChainWork;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            std::copy(diskindex.nZerocoinSupply, diskindex.nZerocoinSupply + libzerocoin::ZEROCOIN_DENOM_COUNT, pindexNew->nZerocoinSupply);
+            std::copy(diskindex.nZerocoinMints, diskindex.nZerocoinMints + libzerocoin::ZEROCOIN_DENOM_COUNT, pindexNew->nZerocoinMints);
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
+                //pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            } else {
+                pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+            }
+            //pindexNew->prevoutStake = diskindex.prevoutStake;
+            //pindexNew->nStakeTime = diskindex.nStakeTime;
+            //pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+            pindexNew->hashProofOfWork = diskindex.hashProofOfWork;
+
+            //populate accumulator checksum map in memory
+            if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+                //Don't load any checkpoints that exist before v2 zspl. The accumulator is invalid for v1 and not used.
+                if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
+                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+
+                nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+            }
+        }
+        nEntries += batch->vIndex.size();
+        nTimeLink += GetTimeMicros() - nStartLink;
+    }
+    std::string strReadError = loader.GetReadError();
+    if (!strReadError.empty())
+        return error("%s : Deserialize or I/O error - %s", __func__, strReadError);
+
+    LogPrint("bench", "    - Read %u block index records: %.2fms\n", nEntries, nTimeRead * 0.001);
+    LogPrint("bench", "    - Decode block index records: %.2fms in %d threads\n", nTimeDecode * 0.001, nThreads);
+    LogPrint("bench", "    - Link block index: %.2fms\n", nTimeLink * 0.001);
+    LogPrint("bench", "    - Load block index records: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
+bool CBlockTreeDB::ReadProofOfWorkHashes(std::map<uint256, uint256>& mapHashes)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('b', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -231,61 +865,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
-                    //pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                } else {
-                    pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
-                }
-                //pindexNew->prevoutStake = diskindex.prevoutStake;
-                //pindexNew->nStakeTime = diskindex.nStakeTime;
-                //pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-                //pindexNew->hashProofOfWork = diskindex.hashProofOfWork;
-
-                // treat PoW and PoS blocks the same - don't waste time on redundant PoW checks that won't catch invalid PoS blocks anyway - nNonce = 0 for PoS blocks
-                if ((pindexNew->nNonce != 0 || pindexNew->nVersion >= Params().WALLET_UPGRADE_VERSION()) && pindexNew->IsProofOfWork() && CBlockHeader::GetAlgo(pindexNew->nVersion) != POW_SCRYPT_SQUARED) {
-                    CBlockHeader header = pindexNew->GetBlockHeader();
-                    if (!CheckProofOfWork(&header))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zspl. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
-
+                if (diskindex.HaveProofOfWorkHash())
+                    mapHashes.insert(std::make_pair(diskindex.GetBlockHash(), diskindex.hashProofOfWork));
                 pcursor->Next();
             } else {
-                break; // if shutdown requested or finished loading block index
+                break;
             }
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -429,3 +1013,78 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(std::make_pair('2', nChecksum));
 }
+
+bool CZerocoinDB::WriteBlockPubcoins(const CBlockIndex* pindex, const std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > vPubcoins;
+    vPubcoins.reserve(listPubcoins.size());
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        vPubcoins.emplace_back(pubcoin.getDenomination(), pubcoin.getValue());
+    return Write(std::make_pair('p', pindex->nHeight), std::make_pair(pindex->GetBlockHash(), vPubcoins));
+}
+
+bool CZerocoinDB::ReadBlockPubcoins(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::pair<uint256, std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > > value;
+    if (!Read(std::make_pair('p', pindex->nHeight), value))
+        return false;
+
+    // the record belongs to whichever block was connected at this height
+    if (value.first != pindex->GetBlockHash())
+        return false;
+
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    for (const std::pair<libzerocoin::CoinDenomination, CBigNum>& pubcoin : value.second)
+        listPubcoins.emplace_back(params, pubcoin.second, pubcoin.first);
+    return true;
+}
+
+bool CZerocoinDB::EraseBlockPubcoins(int nHeight)
+{
+    return Erase(std::make_pair('p', nHeight));
+}
+
+bool CZerocoinDB::LoadBlockMintCounts()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    size_t nBlocks = 0;
+    for (pcursor->Seek("p"); pcursor->Valid() && pcursor->key().starts_with("p"); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            std::pair<uint256, std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > > value;
+            ssValue >> value;
+
+            BlockMap::iterator mi = mapBlockIndex.find(value.first);
+            if (mi == mapBlockIndex.end())
+                continue;
+            CBlockIndex* pindex = mi->second;
+            pindex->ClearMints();
+            for (const std::pair<libzerocoin::CoinDenomination, CBigNum>& pubcoin : value.second)
+                pindex->AddMint(pubcoin.first);
+            nBlocks++;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    if (!pcursor->status().ok())
+        return error("%s : %s", __func__, pcursor->status().ToString());
+
+    LogPrint("zero", "%s : mint counts of %u blocks loaded\n", __func__, nBlocks);
+    return true;
+}
+
+bool CZerocoinDB::WriteFlag(const std::string& name, bool fValue)
+{
+    return Write(std::make_pair('F', name), fValue ? '1' : '0');
+}
+
+bool CZerocoinDB::ReadFlag(const std::string& name, bool& fValue)
+{
+    char ch;
+    if (!Read(std::make_pair('F', name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
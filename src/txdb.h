@@ -11,12 +11,17 @@
 #include "main.h"
 #include "zspl/zerocoin.h"
 
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CCoins;
+class CCoinsSetStats;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -25,23 +30,110 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! Unspent outputs converted per batch when upgrading an old per-transaction chainstate
+static const size_t COINS_UPGRADE_BATCH_OUTPUTS = 200000;
+//! Maximum number of threads decoding block index records on startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Block index records handed to a decoding thread at once
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1024;
+//! Maximum number of batches read ahead of the one being linked
+static const size_t MAX_BLOCK_INDEX_LOAD_QUEUE = 64;
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/).
+ *
+ * Every unspent output is stored as its own record, so spending one output
+ * of a transaction only erases that output instead of rewriting the whole
+ * transaction. Totals and an order-independent hash of the records are
+ * kept up to date on every write, so GetStats does not scan the database.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    void BatchWriteCoins(CLevelDBBatch& batch, leveldb::Iterator* pcursor, const uint256& txid, const CCoins& coins, bool fFresh, CCoinsSetStats& stats, size_t& nWritten, size_t& nErased) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    //! Coin database in another directory than the chainstate
+    CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Write the dirty entries of mapCoins and the best block in one atomic batch, leaving mapCoins untouched
+    bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock);
+
+    //! Convert per-transaction records of an older chainstate into per-outpoint records
+    bool Upgrade();
+
+    //! Recompute the statistics GetStats returns by scanning all output records
+    bool RebuildStats();
+
+    //! Raw access to the underlying database, for UTXO snapshots
+    CLevelDBWrapper& GetDB() { return db; }
 };
 
+/**
+ * CCoinsView between pcoinsTip and the coin database that lets a flush of
+ * pcoinsTip return before the data is on disk.
+ *
+ * While the writer thread runs, BatchWrite freezes the dirty entries into a
+ * pending batch and returns; pcoinsTip then continues as an empty cache on
+ * top of it. The pending batch answers reads until the writer thread has
+ * committed it, together with its best block, in one LevelDB batch, so the
+ * database on disk always describes the state at some flushed block. Only
+ * one batch is pending at a time: a further flush first waits for the
+ * previous one. Without a writer thread, writes go straight through.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB* db;
+
+    //! protects everything below, and mapPending against concurrent modification
+    mutable boost::mutex cs;
+    boost::condition_variable condPending;
+    mutable boost::condition_variable condDone;
+
+    CCoinsMapResource resourcePending;
+    //! frozen entries waiting to be written; not modified while fPending is set
+    CCoinsMap mapPending;
+    uint256 hashBlockPending;
+    bool fPending;
+
+    bool fWriterRunning;
+    bool fFailed;
+    std::string strFailure;
+
+    bool WritePending();
+
+public:
+    CCoinsViewFlusher(CCoinsView* viewIn, CCoinsViewDB* dbIn);
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+
+    //! Wait until the pending batch, if any, is on disk; writes it here if there is no writer thread
+    bool Sync();
+
+    //! Body of the writer thread; returns when interrupted
+    void ThreadWriter();
+};
+
+/**
+ * Layout of the block index records: 1 is the original one, 2 appends the
+ * verified proof-of-work hash of records with BLOCK_HAVE_POW set
+ */
+static const int BLOCK_INDEX_VERSION = 2;
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CLevelDBWrapper
 {
@@ -65,7 +157,15 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    /** Coin age of proof-of-stake treasury blocks, so treasury awards do not depend on old block files */
+    bool WriteStakeCoinAge(const uint256& hashBlock, uint64_t nCoinAge);
+    bool ReadStakeCoinAge(const uint256& hashBlock, uint64_t& nCoinAge);
+    /** Base block and coins hash of a loaded UTXO snapshot whose chain has not been validated yet */
+    bool WriteSnapshotBase(const uint256& hashBlock, const uint256& hashCoins);
+    bool ReadSnapshotBase(uint256& hashBlock, uint256& hashCoins);
+    bool EraseSnapshotBase();
     bool LoadBlockIndexGuts();
+    bool ReadProofOfWorkHashes(std::map<uint256, uint256>& mapHashes);
 };
 
 /** Zerocoin database (zerocoin/) */
@@ -93,6 +193,15 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    /** Pubcoins minted by the active chain block at a height, in block order, with the hash of that block.
+     *  Blocks without mints have no record. */
+    bool WriteBlockPubcoins(const CBlockIndex* pindex, const std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool ReadBlockPubcoins(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool EraseBlockPubcoins(int nHeight);
+    /** Set the mint counts of the block index entries from their pubcoin records, as the block index does not store them */
+    bool LoadBlockMintCounts();
+    bool WriteFlag(const std::string& name, bool fValue);
+    bool ReadFlag(const std::string& name, bool& fValue);
 };
 
 #endif // BITCOIN_TXDB_H
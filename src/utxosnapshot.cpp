@@ -0,0 +1,546 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "guiinterface.h"
+#include "hash.h"
+#include "init.h"
+#include "main.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace
+{
+typedef std::vector<std::pair<std::string, std::string> > RecordList;
+
+/** Serialize a raw database record as a snapshot record, to the file and to the hash of its kind */
+void WriteRecord(CAutoFile& file, CHashWriter& hasher, char chType, const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+{
+    std::string strKey(slKey.data(), slKey.size());
+    std::string strValue(slValue.data(), slValue.size());
+    file << chType << strKey << strValue;
+    hasher << chType << strKey << strValue;
+}
+
+uint256 GetSnapshotHash(const uint256& hashCoins, const uint256& hashZerocoin)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashCoins << hashZerocoin;
+    return ss.GetHash();
+}
+
+/** Hash the output records of a coin database the way a snapshot hashes its 'c' records */
+bool HashCoinRecords(CLevelDBWrapper& db, uint256& hashCoins, uint64_t& nCoins)
+{
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    nCoins = 0;
+    for (pcursor->Seek("C"); pcursor->Valid() && pcursor->key().starts_with("C"); pcursor->Next()) {
+        std::string strKey(pcursor->key().data(), pcursor->key().size());
+        std::string strValue(pcursor->value().data(), pcursor->value().size());
+        hasher << 'c' << strKey << strValue;
+        nCoins++;
+    }
+    if (!pcursor->status().ok())
+        return false;
+    hashCoins = hasher.GetHash();
+    return true;
+}
+
+bool ReadRecords(CLevelDBWrapper& db, RecordList& vRecords)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+        vRecords.push_back(std::make_pair(pcursor->key().ToString(), pcursor->value().ToString()));
+    return pcursor->status().ok();
+}
+
+bool EraseRecords(CLevelDBWrapper& db, const std::string& strPrefix)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CLevelDBBatch batch;
+    unsigned int nBatch = 0;
+    for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+        batch.EraseRaw(pcursor->key());
+        if (++nBatch == SNAPSHOT_LOAD_BATCH_RECORDS) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBatch = 0;
+        }
+    }
+    return pcursor->status().ok() && db.WriteBatch(batch, true);
+}
+
+/** Remove the records a failed load inserted and restore the zerocoin records from before it */
+bool RemoveSnapshotRecords(const RecordList& vZerocoinBefore)
+{
+    if (!EraseRecords(pcoinsdbview->GetDB(), "C") || !EraseRecords(*zerocoinDB, ""))
+        return false;
+    CLevelDBBatch batch;
+    for (const std::pair<std::string, std::string>& record : vZerocoinBefore)
+        batch.WriteRaw(record.first, record.second);
+    return zerocoinDB->WriteBatch(batch, true) && pcoinsdbview->RebuildStats();
+}
+
+bool ReadHeader(CAutoFile& s, CSnapshotInfo& info, std::string& strError)
+{
+    uint32_t nMagic;
+    MessageStartChars pchMessageStart;
+    int nVersion;
+    s >> nMagic >> FLATDATA(pchMessageStart) >> nVersion;
+    if (nMagic != SNAPSHOT_MAGIC) {
+        strError = "not a UTXO snapshot";
+        return false;
+    }
+    if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0) {
+        strError = "snapshot belongs to a different network";
+        return false;
+    }
+    if (nVersion != SNAPSHOT_VERSION) {
+        strError = strprintf("unsupported snapshot version %d", nVersion);
+        return false;
+    }
+    s >> info.hashBlock >> info.nHeight >> info.nBlockIndex;
+    if (info.nHeight < 0 || info.nBlockIndex != (uint64_t)info.nHeight + 1) {
+        strError = "snapshot header is inconsistent";
+        return false;
+    }
+    return true;
+}
+
+/** Check that the block index of a snapshot is a chain of valid headers from genesis, as headers from the network are checked */
+bool CheckSnapshotHeaders(const std::vector<CDiskBlockIndex>& vIndex, std::string& strError)
+{
+    if (vIndex.empty() || vIndex[0].GetBlockHash() != Params().HashGenesisBlock()) {
+        strError = "snapshot chain does not start at the genesis block";
+        return false;
+    }
+
+    uint256 hashPrev = Params().HashGenesisBlock();
+    std::vector<CBlock> vHeaders;
+    for (size_t i = 1; i < vIndex.size(); i++) {
+        const CDiskBlockIndex& diskindex = vIndex[i];
+        uint256 hash = diskindex.GetBlockHash();
+        if (diskindex.hashPrev != hashPrev || diskindex.nHeight != (int)i) {
+            strError = strprintf("snapshot block %s does not extend its predecessor", hash.ToString());
+            return false;
+        }
+        if (!Checkpoints::CheckBlock(diskindex.nHeight, hash)) {
+            strError = strprintf("snapshot block %s does not match the checkpoint at height %d", hash.ToString(), diskindex.nHeight);
+            return false;
+        }
+        hashPrev = hash;
+
+        // Verify the proofs of work a batch at a time on the PoW check threads
+        vHeaders.push_back(CBlock(diskindex.GetBlockHeader()));
+        if (vHeaders.size() == MAX_HEADERS_RESULTS || i + 1 == vIndex.size()) {
+            if (ShutdownRequested()) {
+                strError = "shutdown requested";
+                return false;
+            }
+            CheckHeadersProofOfWork(vHeaders);
+            for (const CBlock& header : vHeaders) {
+                CValidationState state;
+                if (!CheckBlockHeader(header, state, true)) {
+                    strError = strprintf("snapshot block %s has an invalid header: %s", header.GetHash().ToString(), FormatStateMessage(state));
+                    return false;
+                }
+            }
+            vHeaders.clear();
+        }
+    }
+    return true;
+}
+
+/** Insert the 'c' and 'z' records following the block index, hashing exactly what is inserted */
+bool InsertSnapshotRecords(CAutoFile& filein, char chType, CSnapshotInfo& info, std::string& strError)
+{
+    CLevelDBWrapper& dbCoins = pcoinsdbview->GetDB();
+    CHashWriter hasherCoins(SER_DISK, CLIENT_VERSION);
+    CHashWriter hasherZerocoin(SER_DISK, CLIENT_VERSION);
+    CLevelDBBatch batchCoins, batchZerocoin;
+    unsigned int nBatchCoins = 0, nBatchZerocoin = 0;
+    std::string strKey, strValue;
+    try {
+        while (chType != 'e') {
+            if (chType == 'c') {
+                filein >> strKey >> strValue;
+                if (strKey.empty() || strKey[0] != 'C') {
+                    strError = "snapshot chainstate record is not an output record";
+                    return false;
+                }
+                hasherCoins << chType << strKey << strValue;
+                batchCoins.WriteRaw(strKey, strValue);
+                info.nCoins++;
+                if (++nBatchCoins == SNAPSHOT_LOAD_BATCH_RECORDS) {
+                    if (!dbCoins.WriteBatch(batchCoins)) {
+                        strError = "failed to write chainstate";
+                        return false;
+                    }
+                    batchCoins.Clear();
+                    nBatchCoins = 0;
+                }
+            } else if (chType == 'z') {
+                filein >> strKey >> strValue;
+                hasherZerocoin << chType << strKey << strValue;
+                batchZerocoin.WriteRaw(strKey, strValue);
+                info.nZerocoin++;
+                if (++nBatchZerocoin == SNAPSHOT_LOAD_BATCH_RECORDS) {
+                    if (!zerocoinDB->WriteBatch(batchZerocoin)) {
+                        strError = "failed to write zerocoin database";
+                        return false;
+                    }
+                    batchZerocoin.Clear();
+                    nBatchZerocoin = 0;
+                }
+            } else {
+                strError = strprintf("unknown snapshot record type %d", chType);
+                return false;
+            }
+            if (ShutdownRequested()) {
+                strError = "shutdown requested";
+                return false;
+            }
+            filein >> chType;
+        }
+        if (!dbCoins.WriteBatch(batchCoins, true) || !zerocoinDB->WriteBatch(batchZerocoin, true)) {
+            strError = "failed to write snapshot records";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("error reading snapshot: %s", e.what());
+        return false;
+    }
+    info.hashCoins = hasherCoins.GetHash();
+    info.hashSnapshot = GetSnapshotHash(info.hashCoins, hasherZerocoin.GetHash());
+    return true;
+}
+
+bool CanLoadSnapshot(std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Height() != 0) {
+        strError = "a snapshot can only be loaded before any block beyond genesis is connected";
+        return false;
+    }
+    for (const BlockMap::value_type& item : mapBlockIndex) {
+        if (item.second->nHeight > 0 && (item.second->nStatus & BLOCK_HAVE_DATA)) {
+            strError = "block data beyond genesis is already stored";
+            return false;
+        }
+    }
+    // A failed load removes all output records, which is only right if there were none
+    boost::scoped_ptr<leveldb::Iterator> pcursor(pcoinsdbview->GetDB().NewIterator());
+    pcursor->Seek("C");
+    if (pcursor->Valid() && pcursor->key().starts_with("C")) {
+        strError = "the chainstate already holds unspent outputs";
+        return false;
+    }
+    return true;
+}
+
+/** Connect the transactions of a block below the snapshot base to the coins of the validation, checking their inputs like ConnectBlock */
+bool ReplayBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    if (!CheckBlock(block, state))
+        return false;
+
+    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
+            if (!view.HaveInputs(tx))
+                return state.DoS(100, error("%s : inputs of %s missing or spent", __func__, tx.GetHash().ToString()),
+                    REJECT_INVALID, "bad-txns-inputs-missingorspent");
+            if (!CheckInputs(tx, state, view, fScriptChecks, MANDATORY_SCRIPT_VERIFY_FLAGS, false, NULL, NULL))
+                return false;
+        }
+        CTxUndo undoDummy;
+        UpdateCoins(tx, state, view, undoDummy, pindex->nHeight);
+    }
+    view.SetBestBlock(pindex->GetBlockHash());
+    return true;
+}
+} // anon namespace
+
+bool DumpUTXOSnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError)
+{
+    std::vector<CDiskBlockIndex> vIndex;
+    boost::scoped_ptr<leveldb::Iterator> pcursorCoins;
+    boost::scoped_ptr<leveldb::Iterator> pcursorZerocoin;
+    {
+        LOCK(cs_main);
+        // LevelDB iterators read the database as it was when they were created,
+        // so after this flush the file describes the tip however long writing takes.
+        FlushStateToDisk();
+        info.hashBlock = chainActive.Tip()->GetBlockHash();
+        info.nHeight = chainActive.Height();
+        vIndex.reserve(info.nHeight + 1);
+        for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            CDiskBlockIndex diskindex(pindex);
+            diskindex.nStatus = (pindex->nStatus & ~BLOCK_HAVE_MASK) | BLOCK_SNAPSHOT;
+            vIndex.push_back(diskindex);
+        }
+        info.nBlockIndex = vIndex.size();
+        pcursorCoins.reset(pcoinsdbview->GetDB().NewIterator());
+        pcursorZerocoin.reset(zerocoinDB->NewIterator());
+    }
+
+    boost::filesystem::path pathTmp = path.string() + ".new";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("cannot open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    try {
+        CHashWriter hasherCoins(SER_DISK, CLIENT_VERSION);
+        CHashWriter hasherZerocoin(SER_DISK, CLIENT_VERSION);
+        fileout << SNAPSHOT_MAGIC << FLATDATA(Params().MessageStart()) << SNAPSHOT_VERSION;
+        fileout << info.hashBlock << info.nHeight << info.nBlockIndex;
+
+        for (const CDiskBlockIndex& diskindex : vIndex)
+            fileout << 'i' << diskindex;
+        vIndex.clear();
+
+        for (pcursorCoins->Seek("C"); pcursorCoins->Valid() && pcursorCoins->key().starts_with("C"); pcursorCoins->Next()) {
+            if (ShutdownRequested()) {
+                strError = "shutdown requested";
+                return false;
+            }
+            WriteRecord(fileout, hasherCoins, 'c', pcursorCoins->key(), pcursorCoins->value());
+            info.nCoins++;
+        }
+        if (!pcursorCoins->status().ok()) {
+            strError = strprintf("chainstate read failure: %s", pcursorCoins->status().ToString());
+            return false;
+        }
+
+        for (pcursorZerocoin->SeekToFirst(); pcursorZerocoin->Valid(); pcursorZerocoin->Next()) {
+            WriteRecord(fileout, hasherZerocoin, 'z', pcursorZerocoin->key(), pcursorZerocoin->value());
+            info.nZerocoin++;
+        }
+        if (!pcursorZerocoin->status().ok()) {
+            strError = strprintf("zerocoin database read failure: %s", pcursorZerocoin->status().ToString());
+            return false;
+        }
+
+        fileout << 'e';
+        info.hashCoins = hasherCoins.GetHash();
+        info.hashSnapshot = GetSnapshotHash(info.hashCoins, hasherZerocoin.GetHash());
+    } catch (const std::exception& e) {
+        strError = strprintf("error writing snapshot: %s", e.what());
+        return false;
+    }
+
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("cannot rename %s to %s", pathTmp.string(), path.string());
+        return false;
+    }
+
+    LogPrintf("%s: wrote %s at height %d (%u coins, %u zerocoin records, hash %s)\n", __func__,
+        path.string(), info.nHeight, info.nCoins, info.nZerocoin, info.hashSnapshot.ToString());
+    return true;
+}
+
+bool LoadUTXOSnapshot(const boost::filesystem::path& path, const uint256& hashExpected, CSnapshotInfo& info, std::string& strError)
+{
+    if (hashExpected == 0) {
+        strError = "the expected hash of the snapshot has to be given";
+        return false;
+    }
+    {
+        LOCK(cs_main);
+        if (!CanLoadSnapshot(strError))
+            return false;
+    }
+
+    FILE* file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("cannot open %s", path.string());
+        return false;
+    }
+
+    // The block index comes first and is checked before anything is written
+    int64_t nStart = GetTimeMillis();
+    std::vector<CDiskBlockIndex> vIndex;
+    char chType;
+    try {
+        if (!ReadHeader(filein, info, strError))
+            return false;
+        filein >> chType;
+        while (chType == 'i' && vIndex.size() < info.nBlockIndex) {
+            CDiskBlockIndex diskindex;
+            filein >> diskindex;
+            vIndex.push_back(diskindex);
+            filein >> chType;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("error reading snapshot: %s", e.what());
+        return false;
+    }
+    if (vIndex.size() != info.nBlockIndex || vIndex.back().GetBlockHash() != info.hashBlock) {
+        strError = "snapshot block index does not end at its base block";
+        return false;
+    }
+    if (!CheckSnapshotHeaders(vIndex, strError))
+        return false;
+    LogPrint("bench", "    - Verify snapshot headers: %dms\n", GetTimeMillis() - nStart);
+
+    // The records are hashed as they are inserted, in the only pass over them. The chainstate
+    // only points at the snapshot once LoadSnapshotChain writes its best block, so records
+    // that turn out not to match the expected hash are removed again before that.
+    LOCK(cs_main);
+    if (!CanLoadSnapshot(strError))
+        return false;
+    FlushStateToDisk();
+    RecordList vZerocoinBefore;
+    if (!ReadRecords(*zerocoinDB, vZerocoinBefore)) {
+        strError = "zerocoin database read failure";
+        return false;
+    }
+
+    nStart = GetTimeMillis();
+    bool fInserted = InsertSnapshotRecords(filein, chType, info, strError);
+    if (fInserted && info.hashSnapshot != hashExpected) {
+        strError = strprintf("snapshot hash mismatch: %s, expected %s", info.hashSnapshot.ToString(), hashExpected.ToString());
+        fInserted = false;
+    }
+    if (fInserted && !pcoinsdbview->RebuildStats()) {
+        strError = "failed to compute chainstate statistics";
+        fInserted = false;
+    }
+    if (!fInserted || !LoadSnapshotChain(vIndex, info.hashCoins, strError)) {
+        if (!RemoveSnapshotRecords(vZerocoinBefore))
+            strError += "; removing the inserted records failed, the data directory has to be deleted";
+        return false;
+    }
+    LogPrint("bench", "    - Insert snapshot records: %dms\n", GetTimeMillis() - nStart);
+
+    LogPrintf("%s: loaded %s at height %d (%u coins, %u zerocoin records, hash %s)\n", __func__,
+        path.string(), info.nHeight, info.nCoins, info.nZerocoin, info.hashSnapshot.ToString());
+    return true;
+}
+
+void ThreadValidateSnapshot()
+{
+    boost::filesystem::path pathCheck = GetDataDir() / "snapshotcheck";
+    {
+        LOCK(cs_main);
+        // Left behind by a validation that finished just before a shutdown
+        if (pindexSnapshotBase == NULL)
+            boost::filesystem::remove_all(pathCheck);
+    }
+
+    boost::scoped_ptr<CCoinsViewDB> pdbCheck;
+    boost::scoped_ptr<CCoinsViewCache> pviewCheck;
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            CBlockIndex* pindexBase;
+            {
+                LOCK(cs_main);
+                pindexBase = pindexSnapshotBase;
+            }
+            if (pindexBase == NULL) {
+                MilliSleep(5000);
+                continue;
+            }
+            if (!pdbCheck) {
+                // Continues where the validation stopped at the last shutdown
+                pdbCheck.reset(new CCoinsViewDB(pathCheck, SNAPSHOT_VALIDATION_CACHE / 4));
+                pviewCheck.reset(new CCoinsViewCache(pdbCheck.get()));
+                if (pviewCheck->GetBestBlock() == 0)
+                    pviewCheck->SetBestBlock(Params().HashGenesisBlock());
+                LogPrintf("%s: validating the chain below the UTXO snapshot at height %d\n", __func__, pindexBase->nHeight);
+            }
+
+            bool fDone = false;
+            bool fWait = false;
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(pviewCheck->GetBestBlock());
+                if (mi == mapBlockIndex.end() || pindexBase->GetAncestor(mi->second->nHeight) != mi->second) {
+                    AbortNode(strprintf("The snapshot validation database in %s does not belong to the UTXO snapshot at height %d", pathCheck.string(), pindexBase->nHeight));
+                    return;
+                }
+                if (mi->second == pindexBase) {
+                    fDone = true;
+                } else {
+                    CBlockIndex* pindex = pindexBase->GetAncestor(mi->second->nHeight + 1);
+                    // Blocks not downloaded yet are waited for
+                    fWait = !(pindex->nStatus & BLOCK_HAVE_DATA);
+                    if (!fWait) {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, pindex)) {
+                            AbortNode(strprintf("Failed to read block %s for the snapshot validation", pindex->GetBlockHash().ToString()));
+                            return;
+                        }
+                        CValidationState state;
+                        if (!ReplayBlock(block, pindex, *pviewCheck, state)) {
+                            AbortNode(strprintf("Block %s below the UTXO snapshot fails validation: %s", pindex->GetBlockHash().ToString(), FormatStateMessage(state)),
+                                _("Error: The loaded UTXO snapshot does not match the block chain. Delete the data directory and synchronize again."));
+                            return;
+                        }
+                    }
+                }
+            }
+            if (fWait) {
+                MilliSleep(1000);
+                continue;
+            }
+            if ((fDone || pviewCheck->DynamicMemoryUsage() > SNAPSHOT_VALIDATION_CACHE) && !pviewCheck->Flush()) {
+                AbortNode("Failed to write the snapshot validation database");
+                return;
+            }
+            if (!fDone)
+                continue;
+
+            uint256 hashCoins, hashBase, hashExpected;
+            uint64_t nCoins;
+            if (!HashCoinRecords(pdbCheck->GetDB(), hashCoins, nCoins) || !pblocktree->ReadSnapshotBase(hashBase, hashExpected)) {
+                AbortNode("Failed to read the snapshot validation database");
+                return;
+            }
+            if (hashCoins != hashExpected) {
+                AbortNode(strprintf("The chainstate replayed up to the UTXO snapshot at height %d has hash %s instead of %s", pindexBase->nHeight, hashCoins.ToString(), hashExpected.ToString()),
+                    _("Error: The loaded UTXO snapshot does not match the block chain. Delete the data directory and synchronize again."));
+                return;
+            }
+            {
+                LOCK(cs_main);
+                if (!pblocktree->EraseSnapshotBase()) {
+                    AbortNode("Failed to write the block index");
+                    return;
+                }
+                pindexSnapshotBase = NULL;
+            }
+            LogPrintf("%s: validated the chain below the UTXO snapshot at height %d (%u coins)\n", __func__, pindexBase->nHeight, nCoins);
+            pviewCheck.reset();
+            pdbCheck.reset();
+            boost::filesystem::remove_all(pathCheck);
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Keep the progress for the next start
+        if (pviewCheck)
+            pviewCheck->Flush();
+        throw;
+    }
+}
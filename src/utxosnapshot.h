@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_UTXOSNAPSHOT_H
+#define SIMPLICITY_UTXOSNAPSHOT_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * A UTXO snapshot is a flat file holding everything a node needs to continue
+ * the chain from a given block without the blocks before it:
+ *
+ * - header: magic, network message start, format version, base block hash and height
+ * - 'i' records: the block index entries of the active chain from genesis to the base
+ * - 'c' records: the raw chainstate records, one per unspent output
+ * - 'z' records: the raw zerocoin database records (mints, spends, accumulator values)
+ * - 'e' terminator
+ *
+ * The file is written and read strictly sequentially. The hash of a snapshot
+ * covers the 'c' and 'z' records, so that it only depends on the state at the
+ * base block. It cannot be checked against the file itself, so the user has
+ * to give it, taken from a trusted source.
+ * The headers are checked like headers from the network.
+ *
+ * After loading, the blocks below the base are downloaded and replayed on a
+ * separate coin database, which has to end up with the same chainstate
+ * records. Until then the outputs of the snapshot are not used for staking.
+ */
+static const uint32_t SNAPSHOT_MAGIC = 0x78747573; // "sutx"
+static const int SNAPSHOT_VERSION = 2;
+
+/** Number of chainstate or zerocoin records written to the database per batch when loading a snapshot */
+static const unsigned int SNAPSHOT_LOAD_BATCH_RECORDS = 100000;
+/** Memory the coin cache of the snapshot validation may use before it is flushed */
+static const size_t SNAPSHOT_VALIDATION_CACHE = 64 << 20;
+
+struct CSnapshotInfo {
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nBlockIndex;
+    uint64_t nCoins;
+    uint64_t nZerocoin;
+    //! Hash of the 'c' records, what the snapshot validation compares against
+    uint256 hashCoins;
+    //! Hash of the snapshot, over the hashes of its 'c' and 'z' records
+    uint256 hashSnapshot;
+
+    CSnapshotInfo() : hashBlock(0), nHeight(0), nBlockIndex(0), nCoins(0), nZerocoin(0), hashCoins(0), hashSnapshot(0) {}
+};
+
+/** Write the active chain, chainstate and zerocoin database at the current tip to a snapshot file */
+bool DumpUTXOSnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError);
+
+/**
+ * Load a snapshot file into a node that has not connected any block beyond genesis.
+ * hashExpected is the snapshot hash given by the user and may not be 0. If loading fails, the
+ * records inserted so far are removed again.
+ */
+bool LoadUTXOSnapshot(const boost::filesystem::path& path, const uint256& hashExpected, CSnapshotInfo& info, std::string& strError);
+
+/** Replay the blocks below the base of a loaded snapshot as they arrive, and compare the resulting chainstate with the snapshot */
+void ThreadValidateSnapshot();
+
+#endif // SIMPLICITY_UTXOSNAPSHOT_H
@@ -3689,36 +3689,6 @@ UniValue dzsplstate(const UniValue& params, bool fHelp) {
 }
 
 
-void static SearchThread(CzSPLWallet* zwallet, int nCountStart, int nCountEnd)
-{
-    LogPrintf("%s: start=%d end=%d\n", __func__, nCountStart, nCountEnd);
-    CWalletDB walletDB(pwalletMain->strWalletFile);
-    try {
-        uint256 seedMaster = zwallet->GetMasterSeed();
-        uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
-        for(int i = nCountStart; i < nCountEnd; i++) {
-            boost::this_thread::interruption_point();
-            CDataStream ss(SER_GETHASH, 0);
-            ss << seedMaster << i;
-            uint512 zerocoinSeed = Hash512(ss.begin(), ss.end());
-
-            CBigNum bnValue;
-            CBigNum bnSerial;
-            CBigNum bnRandomness;
-            CKey key;
-            zwallet->SeedToZSPL(zerocoinSeed, bnValue, bnSerial, bnRandomness, key);
-
-            uint256 hashPubcoin = GetPubCoinHash(bnValue);
-            zwallet->AddToMintPool(std::make_pair(hashPubcoin, i), true);
-            walletDB.WriteMintPoolPair(hashSeed, hashPubcoin, i);
-        }
-    } catch (std::exception& e) {
-        LogPrintf("SearchThread() exception");
-    } catch (...) {
-        LogPrintf("SearchThread() exception");
-    }
-}
-
 UniValue searchdzspl(const UniValue& params, bool fHelp)
 {
     if(fHelp || params.size() != 3)
@@ -3748,19 +3718,7 @@ UniValue searchdzspl(const UniValue& params, bool fHelp)
     int nThreads = params[2].get_int();
 
     CzSPLWallet* zwallet = pwalletMain->zwalletMain;
-
-    boost::thread_group* dzsplThreads = new boost::thread_group();
-    int nRangePerThread = nRange / nThreads;
-
-    int nPrevThreadEnd = nCount - 1;
-    for (int i = 0; i < nThreads; i++) {
-        int nStart = nPrevThreadEnd + 1;;
-        int nEnd = nStart + nRangePerThread;
-        nPrevThreadEnd = nEnd;
-        dzsplThreads->create_thread(boost::bind(&SearchThread, zwallet, nStart, nEnd));
-    }
-
-    dzsplThreads->join_all();
+    zwallet->GenerateMintPool(nCount, nRange, nThreads);
 
     zwallet->RemoveMintsFromPool(pwalletMain->zsplTracker->GetSerialHashes());
     zwallet->SyncWithChain(false);
@@ -52,6 +52,14 @@ bool bdisableSystemnotifications = false; // Those bubbles can be annoying and s
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
 bool fGlobalUnlockSpendCache = false;
+
+namespace
+{
+//! Wakes the precompute thread when the chain tip changes
+boost::mutex csPrecompute;
+boost::condition_variable cvPrecompute;
+bool fPrecomputeTipChanged = true;
+} // anon namespace
 int64_t nStartupTime = GetTime(); //!< Client startup time for use with automint
 
 /**
@@ -1815,6 +1823,10 @@ bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInp
             if (!Params().HasStakeMinAgeOrDepth(blockHeight, GetAdjustedTime(), utxoBlock->nHeight, utxoBlock->GetBlockTime()))
                 continue;
 
+            //outputs taken from a UTXO snapshot only stake once the chain below it is validated
+            if (pindexSnapshotBase && utxoBlock->nHeight <= pindexSnapshotBase->nHeight)
+                continue;
+
             //add to our stake set
             nAmountSelected += out.tx->vout[out.i].nValue;
 
@@ -1879,6 +1891,8 @@ bool CWallet::MintableCoins()
         int64_t time = GetAdjustedTime();
         for (const COutput& out : vCoins) {
             CBlockIndex* utxoBlock = mapBlockIndex.at(out.tx->hashBlock);
+            if (pindexSnapshotBase && utxoBlock->nHeight <= pindexSnapshotBase->nHeight)
+                continue;
             //check for maturity (min age/depth)
             if (Params().HasStakeMinAgeOrDepth(chainHeight, time, utxoBlock->nHeight, utxoBlock->nTime))
                 return true;
@@ -2266,8 +2280,10 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, CAmount> >&
 
                 // Sign
                 int nIn = 0;
+                const CTransaction txNewConst(txNew);
+                const PrecomputedTransactionData txdata(txNewConst);
                 for (const PAIRTYPE(const CWalletTx*, unsigned int) & coin : setCoins)
-                    if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+                    if (!SignSignature(*this, *coin.first, txNewConst, txdata, txNew, nIn++)) {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
@@ -2485,9 +2501,11 @@ bool CWallet::CreateCoinStake(
     // Sign for SPL
     int nIn = 0;
     if (!txNew.vin[0].scriptSig.IsZerocoinSpend()) {
-        for (CTxIn txIn : txNew.vin) {
+        const CTransaction txNewConst(txNew);
+        const PrecomputedTransactionData txdata(txNewConst);
+        for (const CTxIn& txIn : txNewConst.vin) {
             const CWalletTx *wtx = GetWalletTx(txIn.prevout.hash);
-            if (!SignSignature(*this, *wtx, txNew, nIn++))
+            if (!SignSignature(*this, *wtx, txNewConst, txdata, txNew, nIn++))
                 return error("CreateCoinStake : failed to sign coinstake");
         }
     } else {
@@ -3867,8 +3885,10 @@ bool CWallet::CreateZerocoinMintTransaction(const CAmount nValue, CMutableTransa
     // Sign if these are simplicity outputs - NOTE that zSPL outputs are signed later in SoK
     if (!isZCSpendChange) {
         int nIn = 0;
+        const CTransaction txNewConst(txNew);
+        const PrecomputedTransactionData txdata(txNewConst);
         for (const std::pair<const CWalletTx*, unsigned int>& coin : setCoins) {
-            if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+            if (!SignSignature(*this, *coin.first, txNewConst, txdata, txNew, nIn++)) {
                 strFailReason = _("Signing transaction failed");
                 return false;
             }
@@ -4803,283 +4823,109 @@ void ThreadPrecomputeSpends()
     LogPrintf("ThreadPrecomputeSpends exiting,\n");
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csPrecompute);
+        fPrecomputeTipChanged = true;
+    }
+    cvPrecompute.notify_one();
+}
+
 void CWallet::PrecomputeSpends()
 {
-    // We don't even need to worry about this code.. no zSPL.
-    /*
     LogPrintf("Precomputer started\n");
     RenameThread("simplicity-precomputer");
 
     CWalletDB walletdb("precomputes.dat", "cr+");
 
-    // Create LRU Cache
-    std::list<std::pair<uint256, CoinWitnessCacheData> > item_list;
-    std::map<uint256, std::list<std::pair<uint256, CoinWitnessCacheData> >::iterator> item_map;
-
-    // Dirty cache that needs to be written to disk
-    std::map<uint256, CoinWitnessCacheData> mapDirtyWitnessData;
-
-    // Initialize Variables
-    bool fLoadedPrecomputesFromDB = false;
-    bool fOnFirstLoad = true;
-    int64_t nLastCacheCleanUpTime = GetTime();
-    int64_t nLastCacheWriteDB = nLastCacheCleanUpTime;
-    int nRequiredStakeDepthBuffer = Params().Zerocoin_RequiredStakeDepth() + 10;
-    int nAdjustableCacheLength = GetArg("-precomputecachelength", DEFAULT_PRECOMPUTE_LENGTH);
-
-    // Force the cache length to be divisible by 10
-    if (nAdjustableCacheLength % 10)
-        nAdjustableCacheLength -= nAdjustableCacheLength % 10;
-
-    if (nAdjustableCacheLength < MIN_PRECOMPUTE_LENGTH)
-        nAdjustableCacheLength = MIN_PRECOMPUTE_LENGTH;
-
-    if (nAdjustableCacheLength > MAX_PRECOMPUTE_LENGTH)
-        nAdjustableCacheLength = MAX_PRECOMPUTE_LENGTH;
-
     while (true) {
-        // Check to see if we need to clear the cache
-        if (fClearSpendCache) {
-            fClearSpendCache = false;
-            item_map.clear();
-            item_list.clear();
-            mapDirtyWitnessData.clear();
-            nLastCacheCleanUpTime = GetTime();
-            nLastCacheWriteDB = nLastCacheCleanUpTime;
-        }
-
-        // Get the list of zSPL inputs
-        std::list <std::unique_ptr<CStakeInput>> listInputs;
-        if (!SelectStakeCoins(listInputs, 0, true)) {
-            MilliSleep(5000);
-            continue;
-        }
-
-        if (listInputs.empty()) {
-            MilliSleep(5000);
-            continue;
+        {
+            // Witnesses only change when the tip does
+            boost::unique_lock<boost::mutex> lock(csPrecompute);
+            while (!fPrecomputeTipChanged)
+                cvPrecompute.wait(lock);
+            fPrecomputeTipChanged = false;
         }
+        boost::this_thread::interruption_point();
 
         if (ShutdownRequested())
             break;
+        if (IsLocked() || IsInitialBlockDownload())
+            continue;
 
-        while (IsLocked())
-            MilliSleep(5000);
-
-        // If we haven't loaded from database yet, load the precomputes from the database
-        if (!fLoadedPrecomputesFromDB) {
-            // Load the precomputes into the LRU cache
-            walletdb.LoadPrecomputes(item_list, item_map);
-            fLoadedPrecomputesFromDB = true;
-            LogPrint("precompute", "%s: Loaded precomputes from database. Size of lru cache: %d\n", __func__,
-                     item_map.size());
-        }
-
-        // Do some precomputing of zerocoin spend knowledge proofs
-        std::set <uint256> setInputHashes;
-        for (std::unique_ptr <CStakeInput>& stakeInput : listInputs) {
-            if (ShutdownRequested() || IsLocked())
-                break;
-
-            CoinWitnessCacheData tempDataHolder;
-
-            {
-                TRY_LOCK(zsplTracker->cs_spendcache, fLocked);
-                if (!fLocked)
-                    continue;
-
-                if (fGlobalUnlockSpendCache) {
-                    break;
-                }
-
-                // When we see a clear spend cache bool set to true, break out of the loop
-                // All cache data will be cleared at the beginning of the while loop above
-                if (fClearSpendCache) {
-                    break;
-                }
-
-                uint256 serialHash = stakeInput->GetSerialHash();
-                setInputHashes.insert(serialHash);
-                CoinWitnessData* witnessData = zsplTracker->GetSpendCache(serialHash);
-
-                // Initialize nHeightStop so it can be set below
-                int nHeightStop = 0;
-
-                if (witnessData->nHeightAccStart) { // Witness is already valid
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-                } else if (item_map.count(serialHash)) { // Check Database cache
-                    // Get the witness data from the cache
-                    auto it = item_map.find(serialHash);
-                    item_list.splice(item_list.begin(), item_list, it->second);
-
-                    *witnessData = CoinWitnessData(it->second->second);
-
-                    // Set the stop height from the variables received from the database cache
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-
-                    LogPrint("precompute", "%s: Got Witness Data from lru cache: %s\n", __func__,
-                             witnessData->ToString());
-                } else if (mapDirtyWitnessData.count(serialHash) || walletdb.ReadPrecompute(serialHash, tempDataHolder)) {
-                    if (mapDirtyWitnessData.count(serialHash)) {
-                        // Get the witness data from the dirty cache if it exists
-                        *witnessData = CoinWitnessData(mapDirtyWitnessData.at(serialHash));
-                        LogPrint("precompute", "%s: Got Witness Data from mapDirtyWitnessData: %s\n", __func__,
-                                 witnessData->ToString());
-                    } else {
-                        // Get the witness data from the database
-                        *witnessData = CoinWitnessData(tempDataHolder);
-                        LogPrint("precompute", "%s: Got Witness Data from precompute database: %s\n", __func__,
-                                 witnessData->ToString());
-                    }
-
-                    // Set the stop height from the variables received from the database cache
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-
-                    // Add the serialHash found into the cache
-                    item_list.push_front(std::make_pair(serialHash, tempDataHolder));
-                    item_map.insert(std::make_pair(serialHash, item_list.begin()));
-
-                    // We just added a new hash into our LRU cache, so remove it if we also have it in the dirty map
-                    mapDirtyWitnessData.erase(serialHash);
-
-                    if (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
-                        auto last_it = item_list.end(); last_it --;
-                        item_map.erase(last_it->first);
-                        CoinWitnessCacheData removedData = item_list.back().second;
-                        mapDirtyWitnessData[serialHash] = removedData;
-                        item_list.pop_back();
-                    }
-                } else { // This has no cache, so initialize it
-                    CZerocoinMint mint;
-                    if (!GetMintFromStakeHash(serialHash, mint))
-                        continue;
-                    *witnessData = CoinWitnessData(mint);
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           mint.GetHeight() + nAdjustableCacheLength);
-                }
-
-                if (nHeightStop - (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd : witnessData->nHeightAccStart) < 20)
-                    continue;
-
-                CBlockIndex* pindexStop = chainActive[nHeightStop];
-                AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
-                LogPrint("precompute","%s: caching mint %s of denom %d start=%d stop=%d end=%s\n", __func__,
-                          witnessData->coin->getValue().GetHex().substr(0, 6),
-                          ZerocoinDenominationToInt(witnessData->denom),
-                          witnessData->nHeightAccStart, nHeightStop, witnessData->nHeightAccEnd);
-
-                if (!GenerateAccumulatorWitness(witnessData, mapAccumulators, pindexStop)) {
-                    LogPrintf("%s: Generate witness failed!\n", __func__);
-
-                    // If we fail this check, we need to make sure we remove this from the LRU cache
-                    auto it = item_map.find(serialHash);
-                    if (it != item_map.end())
-                    {
-                        item_list.erase(it->second);
-                        item_map.erase(it);
-                    }
-                    mapDirtyWitnessData.erase(serialHash);
-                    walletdb.ErasePrecompute(serialHash);
-                    continue;
-                }
-
-
-                CoinWitnessCacheData serialData(witnessData);
-
-                // If the LRU cache already has a entry for it, update the entry and move it to the front of the list
-                auto it = item_map.find(serialHash);
-                if (it != item_map.end()) {
-                    item_list.splice(item_list.begin(), item_list, it->second);
-                    item_list.begin()->second = serialData;
-                } else {
-                    item_list.push_front(std::make_pair(serialHash, serialData));
-                    item_map.insert(std::make_pair(serialHash, item_list.begin()));
-                }
-
-                // We just added a new hash into our LRU cache, so remove it if we also have it in the dirty map
-                mapDirtyWitnessData.erase(serialHash);
+        UpdateSpendCache(walletdb);
+    }
+}
 
-                // Clean up the LRU cache to the max size
-                while (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
-                    auto last_it = item_list.end(); last_it --;
-                    item_map.erase(last_it->first);
-                    mapDirtyWitnessData[serialHash] = item_list.back().second;
-                    item_list.pop_back();
-                }
-            }
-            // Sleep for 150ms to allow any potential spend attempt
-            MilliSleep(150);
-        }
+void CWallet::UpdateSpendCache(CWalletDB& walletdb)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setStakeHashes;
+    int nUpdated = 0;
+    for (const CMintMeta& meta : zsplTracker->ListMints(true, true, false)) {
+        if (ShutdownRequested() || IsLocked())
+            return;
+        setStakeHashes.insert(meta.hashStake);
 
-        if (fGlobalUnlockSpendCache) {
+        TRY_LOCK(zsplTracker->cs_spendcache, fLocked);
+        // A spend or stake waiting for the cache goes first, the next tip picks up from here
+        if (!fLocked || fGlobalUnlockSpendCache) {
             fGlobalUnlockSpendCache = false;
+            return;
         }
 
-        // On first load, and every 5 minutes clean up our cache with only valid unspent inputs
-        if (fOnFirstLoad || nLastCacheCleanUpTime < GetTime() - PRECOMPUTE_FLUSH_TIME) {
-            LogPrint("precompute", "%s: Cleaning up precompute cache\n", __func__);
-
-            // We only want to clear the cache if we have calculated new witness data
-            if (setInputHashes.size()) {
-                // Get a list of hashes currently in the database
-                std::set <uint256> databaseHashes;
-                walletdb.LoadPrecomputes(databaseHashes);
-
-                // Remove old cache data
-                for (auto inputHash : setInputHashes) {
-                    databaseHashes.erase(inputHash);
-                }
-
-                // Erase all old hashes from the database
-                for (auto hash : databaseHashes) {
-                    auto it = item_map.find(hash);
-                    if (it != item_map.end())
-                    {
-                        item_list.erase(it->second);
-                        item_map.erase(it);
-                    }
-                    mapDirtyWitnessData.erase(hash);
-                    walletdb.ErasePrecompute(hash);
-                }
+        // Cleared by clearspendcache together with the database, start over
+        if (fClearSpendCache)
+            fClearSpendCache = false;
 
-                nLastCacheCleanUpTime = GetTime();
+        CoinWitnessData* witnessData = zsplTracker->GetSpendCache(meta.hashStake);
+        if (!witnessData->nHeightAccEnd) {
+            CoinWitnessCacheData cacheData;
+            CZerocoinMint mint;
+            if (walletdb.ReadPrecompute(meta.hashStake, cacheData)) {
+                *witnessData = CoinWitnessData(cacheData);
+            } else if (GetMint(meta.hashSerial, mint)) {
+                *witnessData = CoinWitnessData(mint);
+                witnessData->SetHeightMintAdded(mint.GetHeight());
+            } else {
+                continue;
             }
         }
 
-        // On first load, and every 5 minutes write the cache to database
-        if (mapDirtyWitnessData.size() > PRECOMPUTE_MAX_DIRTY_CACHE_SIZE || nLastCacheWriteDB < GetTime() - PRECOMPUTE_FLUSH_TIME || ShutdownRequested()) {
-            // Save all cache data that was dirty back into the database
-            for (auto item : mapDirtyWitnessData) {
-                walletdb.WritePrecompute(item.first, item.second);
-            }
-            mapDirtyWitnessData.clear();
-
-            // Save the LRU cache data into the database
-            for (auto item : item_list) {
-                walletdb.WritePrecompute(item.first, item.second);
+        // Only the blocks after nHeightAccEnd are accumulated, or all of them again after a reorg below it
+        int nHeightAccEnd = witnessData->nHeightAccEnd;
+        uint256 hashBlockAccEnd = witnessData->hashBlockAccEnd;
+        // A failed generation may leave a partly accumulated witness behind, which is put back as it was
+        CoinWitnessCacheData cacheBefore;
+        if (nHeightAccEnd)
+            cacheBefore = CoinWitnessCacheData(witnessData);
+        AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
+        if (!GenerateAccumulatorWitness(witnessData, mapAccumulators, NULL)) {
+            LogPrint("precompute", "%s: witness of mint %s not ready\n", __func__, meta.hashPubcoin.GetHex());
+            if (nHeightAccEnd) {
+                *witnessData = CoinWitnessData(cacheBefore);
+            } else {
+                witnessData->nHeightAccEnd = 0;
+                witnessData->nMintsAdded = 0;
             }
-
-            LogPrint("precompute", "%s: Writing precomputes to database. Precomputes size: %d\n", __func__, item_map.size());
-            nLastCacheWriteDB = GetTime();
+            continue;
         }
 
-        fOnFirstLoad = false;
-
-        if (ShutdownRequested())
-            break;
+        if (witnessData->nHeightAccEnd != nHeightAccEnd || witnessData->hashBlockAccEnd != hashBlockAccEnd) {
+            walletdb.WritePrecompute(meta.hashStake, CoinWitnessCacheData(witnessData));
+            nUpdated++;
+        }
+    }
 
-        LogPrint("precompute", "%s: Finished precompute round...\n\n", __func__);
-        MilliSleep(5000);
+    // Drop the witnesses of mints that were spent or archived
+    std::set<uint256> setHashes;
+    walletdb.LoadPrecomputes(setHashes);
+    for (const uint256& hash : setHashes) {
+        if (!setStakeHashes.count(hash))
+            walletdb.ErasePrecompute(hash);
+    }
 
-    }*/
+    LogPrint("precompute", "%s: updated %d of %u witnesses in %.2fms\n", __func__, nUpdated, setStakeHashes.size(), 0.001 * (GetTimeMicros() - nTimeStart));
 }
 
@@ -384,7 +384,9 @@ public:
 
     const CWalletTx* GetWalletTx(const uint256& hash) const;
 
+    //! Keep the witnesses of unspent mints in the spend cache and precomputes.dat up to date with the tip
     void PrecomputeSpends();
+    void UpdateSpendCache(CWalletDB& walletdb);
 
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf)
@@ -472,6 +474,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex* pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false);
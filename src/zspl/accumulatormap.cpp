@@ -8,6 +8,10 @@
 #include "txdb.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 
 //Construct accumulators for all denominations
 AccumulatorMap::AccumulatorMap(libzerocoin::ZerocoinParams* params)
@@ -71,6 +75,48 @@ bool AccumulatorMap::Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSk
     return true;
 }
 
+//Add zerocoins to the accumulators of their denominations without validating them.
+//The denominations are independent, so each one is raised on its own thread.
+bool AccumulatorMap::AccumulateBatch(const std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > mapValues;
+    for (const libzerocoin::PublicCoin& pubCoin : listPubcoins) {
+        if (pubCoin.getDenomination() == libzerocoin::CoinDenomination::ZQ_ERROR)
+            return false;
+        mapValues[pubCoin.getDenomination()].emplace_back(pubCoin.getValue());
+    }
+
+    std::vector<std::pair<libzerocoin::Accumulator*, const std::vector<CBigNum>*> > vJobs;
+    for (const auto& denomValues : mapValues)
+        vJobs.emplace_back(mapAccumulators.at(denomValues.first).get(), &denomValues.second);
+
+    std::atomic<size_t> nNextJob(0);
+    std::atomic<bool> fFailed(false);
+    auto worker = [&vJobs, &nNextJob, &fFailed]() {
+        for (size_t i = nNextJob++; i < vJobs.size(); i = nNextJob++) {
+            try {
+                vJobs[i].first->incrementBatch(*vJobs[i].second);
+            } catch (const std::exception& e) {
+                LogPrintf("AccumulateBatch : %s\n", e.what());
+                fFailed = true;
+            }
+        }
+    };
+
+    int nThreads = std::min((int)vJobs.size(), std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_ACCUMULATOR_THREADS)));
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.create_thread([&worker]() {
+            RenameThread("simplicity-accumulate");
+            worker();
+        });
+    }
+    worker();
+    threads.join_all();
+
+    return !fFailed;
+}
+
 libzerocoin::Accumulator AccumulatorMap::GetAccumulator(libzerocoin::CoinDenomination denom)
 {
     return libzerocoin::Accumulator(params, denom, GetValue(denom));
@@ -9,6 +9,9 @@
 #include "libzerocoin/Coin.h"
 #include "accumulatorcheckpoints.h"
 
+//! Maximum number of threads raising accumulators of different denominations at once
+static const int MAX_ACCUMULATOR_THREADS = 8;
+
 //A map with an accumulator for each denomination
 class AccumulatorMap
 {
@@ -20,6 +23,7 @@ public:
     bool Load(uint256 nCheckpoint);
     void Load(const AccumulatorCheckpoints::Checkpoint& checkpoint);
     bool Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSkipValidation = false);
+    bool AccumulateBatch(const std::list<libzerocoin::PublicCoin>& listPubcoins);
     libzerocoin::Accumulator GetAccumulator(libzerocoin::CoinDenomination denom);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
@@ -13,6 +13,8 @@
 #include "zsplchain.h"
 #include "tinyformat.h"
 
+#include <boost/thread.hpp>
+
 
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
@@ -265,6 +267,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
     int nTotalMintsFound = 0;
+    std::list<libzerocoin::PublicCoin> listRangePubcoins;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
 
     while (pindex->nHeight < nHeight - 10) {
@@ -278,26 +281,33 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
             continue;
         }
 
-        //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
-            return error("%s: failed to read block from disk", __func__);
-
+        //grab mints from this block, the pubcoin index holds them with the invalid outpoints filtered out
         std::list<libzerocoin::PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
-            return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+        if (fFilterInvalid) {
+            try {
+                listPubcoins = GetPubcoinFromBlock(pindex);
+            } catch (const GetPubcoinException& e) {
+                return error("%s: %s", __func__, e.message);
+            }
+        } else {
+            CBlock block;
+            if(!ReadBlockFromDisk(block, pindex))
+                return error("%s: failed to read block from disk", __func__);
+            if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
+                return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+        }
 
         nTotalMintsFound += listPubcoins.size();
         LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
 
-        //add the pubcoins to accumulator
-        for (const libzerocoin::PublicCoin& pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true))
-                return error("%s: failed to add pubcoin to accumulator at height %d", __func__, pindex->nHeight);
-        }
+        listRangePubcoins.splice(listRangePubcoins.end(), listPubcoins);
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins of the whole range to the accumulators, one denomination per thread
+    if (!mapAccumulators.AccumulateBatch(listRangePubcoins))
+        return error("%s: failed to add pubcoins to accumulators at height %d", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
     if (nTotalMintsFound == 0)
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
@@ -350,7 +360,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
     int n = 0;
     while (pindex->nHeight < nHeightEnd) {
-        n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+        n += pindex->GetMintCount(denom);
         pindex = chainActive.Next(pindex);
     }
 
@@ -359,11 +369,20 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 
 
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex){
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    //blocks of the active chain have their mints indexed when connected
+    if (zerocoinDB->ReadBlockPubcoins(pindex, listPubcoins))
+        return listPubcoins;
+
+    //once every block of the active chain is indexed, one without a record has no mints, even if it was pruned
+    bool fIndexed = false;
+    if (chainActive.Contains(pindex) && zerocoinDB->ReadFlag("pubcoinindex", fIndexed) && fIndexed)
+        return listPubcoins;
+
     //grab mints from this block
     CBlock block;
     if(!ReadBlockFromDisk(block, pindex))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to read block from disk while adding pubcoins to witness");
-    std::list<libzerocoin::PublicCoin> listPubcoins;
     if(!BlockToPubcoinList(block, listPubcoins, true))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
     return listPubcoins;
@@ -375,7 +394,7 @@ int AddBlockMintsToAccumulator(const libzerocoin::CoinDenomination den, const CB
                                libzerocoin::Accumulator* accumulator, bool isWitness, std::list<CBigNum>& notAddedCoins)
 {
     // if this block contains mints of the denomination that is being spent, then add them to the witness
-    int nMintsAdded = 0;
+    std::vector<CBigNum> vValues;
     if (pindex->MintedDenomination(den)) {
         //add the mints to the witness
         for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
@@ -388,19 +407,19 @@ int AddBlockMintsToAccumulator(const libzerocoin::CoinDenomination den, const CB
                 continue;
             }
 
-            accumulator->increment(pubcoin.getValue());
-            ++nMintsAdded;
+            vValues.emplace_back(pubcoin.getValue());
         }
+        accumulator->incrementBatch(vValues);
     }
 
-    return nMintsAdded;
+    return vValues.size();
 }
 
 int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nHeightMintAdded, const CBlockIndex* pindex,
                                libzerocoin::Accumulator* accumulator, bool isWitness)
 {
     // if this block contains mints of the denomination that is being spent, then add them to the witness
-    int nMintsAdded = 0;
+    std::vector<CBigNum> vValues;
     if (pindex->MintedDenomination(coin.getDenomination())) {
         //add the mints to the witness
         for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
@@ -410,12 +429,12 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
             if (isWitness && pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
                 continue;
 
-            accumulator->increment(pubcoin.getValue());
-            ++nMintsAdded;
+            vValues.emplace_back(pubcoin.getValue());
         }
+        accumulator->incrementBatch(vValues);
     }
 
-    return nMintsAdded;
+    return vValues.size();
 }
 
 
@@ -512,6 +531,7 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
     while (pindex && pindex->nHeight <= nHeightEnd) {
         coinWitness->nMintsAdded += AddBlockMintsToAccumulator(coinWitness, pindex, true);
         coinWitness->nHeightAccEnd = pindex->nHeight;
+        coinWitness->hashBlockAccEnd = pindex->GetBlockHash();
 
         // 10 blocks were accumulated twice when zSPL v2 was activated
         // if (pindex->nHeight == Params().Zerocoin_Block_Double_Accumulated() + 10 && !fDoubleCounted) {
@@ -537,8 +557,17 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
 
         int64_t nTimeStart = GetTimeMicros();
 
+        //A reorg below the accumulated range invalidates the witness, accumulate again from the mint
+        if (coinWitness->nHeightAccEnd && (coinWitness->nHeightAccEnd > chainActive.Height() ||
+                chainActive[coinWitness->nHeightAccEnd]->GetBlockHash() != coinWitness->hashBlockAccEnd)) {
+            LogPrint("zero", "%s: block %d is no longer in the active chain, resetting witness\n", __func__, coinWitness->nHeightAccEnd);
+            coinWitness->nHeightAccEnd = 0;
+            coinWitness->nMintsAdded = 0;
+        }
+
         //If there is a Acc End height filled in, then this has already been partially accumulated.
-        if (!coinWitness->nHeightAccEnd) {
+        bool fReset = !coinWitness->nHeightAccEnd;
+        if (fReset) {
             LogPrintf("RESET ACC\n");
             coinWitness->pAccumulator = std::unique_ptr<libzerocoin::Accumulator>(new libzerocoin::Accumulator(Params().Zerocoin_Params(false), coinWitness->denom));
             coinWitness->pWitness = std::unique_ptr<libzerocoin::AccumulatorWitness>(new libzerocoin::AccumulatorWitness(Params().Zerocoin_Params(false), *coinWitness->pAccumulator, *coinWitness->coin));
@@ -572,6 +601,12 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
         if (nHeightStop > coinWitness->nHeightAccEnd)
             AccumulateRange(coinWitness, nHeightStop - 1);
 
+        // calculate how many mints of this denomination existed in the accumulator we initialized,
+        // once, as soon as the reset accumulation is persisted so that later calls continue from it
+        if (fReset && coinWitness->nHeightAccEnd)
+            coinWitness->nMintsAdded += ComputeAccumulatedCoins(coinWitness->nHeightAccStart, coinWitness->denom);
+        LogPrint("zero", "%s : %d mints added to witness\n", __func__, coinWitness->nMintsAdded);
+
         mapAccumulators.Load(chainActive[nHeightStop + 10]->nAccumulatorCheckpoint);
         coinWitness->pWitness->resetValue(*coinWitness->pAccumulator, *coinWitness->coin);
         if(!coinWitness->pWitness->VerifyWitness(mapAccumulators.GetAccumulator(coinWitness->denom), *coinWitness->coin))
@@ -581,10 +616,6 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
         if (coinWitness->nMintsAdded < Params().Zerocoin_RequiredAccumulation())
             return error("%s : Less than %d mints added, unable to create spend. %s", __func__, Params().Zerocoin_RequiredAccumulation(), coinWitness->ToString());
 
-        // calculate how many mints of this denomination existed in the accumulator we initialized
-        coinWitness->nMintsAdded += ComputeAccumulatedCoins(coinWitness->nHeightAccStart, coinWitness->denom);
-        LogPrint("zero", "%s : %d mints added to witness\n", __func__, coinWitness->nMintsAdded);
-
         int64_t nTime1 = GetTimeMicros();
         LogPrint("bench", "        - Witness generated in %.2fms\n", 0.001 * (nTime1 - nTimeStart));
 
@@ -600,6 +631,57 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
     }
 }
 
+void CAccumulatorRangeCache::Add(libzerocoin::CoinDenomination den, int nHeightFrom, int nHeightTo, const CBigNum& bnBase,
+                                 const CBigNum& bnValue, const uint256& hashBlockTo, int nMints)
+{
+    LOCK(cs);
+    RangeKey key(den, nHeightFrom, nHeightTo);
+    if (mapEntries.count(key))
+        return;
+    while (!dequeOrder.empty() && mapEntries.size() >= nMaxEntries) {
+        mapEntries.erase(dequeOrder.front());
+        dequeOrder.pop_front();
+    }
+    CEntry& entry = mapEntries[key];
+    entry.bnBase = bnBase;
+    entry.bnValue = bnValue;
+    entry.hashBlockTo = hashBlockTo;
+    entry.nMints = nMints;
+    dequeOrder.push_back(key);
+}
+
+bool CAccumulatorRangeCache::GetLongest(libzerocoin::CoinDenomination den, int nHeightFrom, int nHeightMax, const CBigNum& bnBase,
+                                        int& nHeightTo, CBigNum& bnValue, uint256& hashBlockTo, int& nMints) const
+{
+    LOCK(cs);
+    std::map<RangeKey, CEntry>::const_iterator itBegin = mapEntries.lower_bound(RangeKey(den, nHeightFrom, nHeightFrom + 1));
+    std::map<RangeKey, CEntry>::const_iterator it = mapEntries.upper_bound(RangeKey(den, nHeightFrom, nHeightMax));
+    while (it != itBegin) {
+        --it;
+        if (it->second.bnBase != bnBase)
+            continue;
+        nHeightTo = std::get<2>(it->first);
+        bnValue = it->second.bnValue;
+        hashBlockTo = it->second.hashBlockTo;
+        nMints = it->second.nMints;
+        return true;
+    }
+    return false;
+}
+
+size_t CAccumulatorRangeCache::Size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+void CAccumulatorRangeCache::Clear()
+{
+    LOCK(cs);
+    mapEntries.clear();
+    dequeOrder.clear();
+}
+
 bool calculateAccumulatedBlocksFor(
         int startHeight,
         int nHeightStop,
@@ -610,11 +692,53 @@ bool calculateAccumulatedBlocksFor(
         CBloomFilter filter,
         libzerocoin::Accumulator &witnessAccumulator,
         std::list<CBigNum>& ret,
-        std::string& strError
+        std::string& strError,
+        CAccumulatorRangeCache* pcache
 ){
     // bool fDoubleCounted = false;
     int nMintsAdded = 0;
+
+    // Every coin before the first block holding one that matches the filter is accumulated,
+    // the same for every request starting here, so that stretch can be shared through the cache
+    const int nHeightFrom = pindex ? pindex->nHeight : 0;
+    const CBigNum bnBase = witnessAccumulator.getValue();
+    int nHeightShared = nHeightStop;
+    if (pcache && pindex) {
+        for (CBlockIndex* pindexScan = pindex; pindexScan && pindexScan->nHeight < nHeightStop; pindexScan = chainActive.Next(pindexScan)) {
+            if (!pindexScan->MintedDenomination(den))
+                continue;
+            bool fMatch = false;
+            for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindexScan)) {
+                if (pubcoin.getDenomination() == den && filter.contains(pubcoin.getValue().getvch())) {
+                    fMatch = true;
+                    break;
+                }
+            }
+            if (fMatch) {
+                nHeightShared = pindexScan->nHeight;
+                break;
+            }
+        }
+
+        int nHeightTo = 0;
+        int nMints = 0;
+        CBigNum bnValue;
+        uint256 hashBlockTo;
+        if (pcache->GetLongest(den, nHeightFrom, nHeightShared, bnBase, nHeightTo, bnValue, hashBlockTo, nMints) &&
+                chainActive[nHeightTo] && chainActive[nHeightTo]->GetBlockHash() == hashBlockTo) {
+            LogPrint("zero", "%s : reusing accumulation of blocks %d to %d\n", __func__, nHeightFrom, nHeightTo);
+            witnessAccumulator.setValue(bnValue);
+            nMintsAdded += nMints;
+            pindex = chainActive[nHeightTo];
+        }
+    }
+
     while (pindex) {
+        boost::this_thread::interruption_point();
+
+        if (pcache && pindex->nHeight > nHeightFrom && pindex->nHeight <= nHeightShared &&
+                (pindex->nHeight == nHeightShared || (pindex->nHeight - nHeightFrom) % LIGHT_ACCUMULATOR_CACHE_INTERVAL == 0))
+            pcache->Add(den, nHeightFrom, pindex->nHeight, bnBase, witnessAccumulator.getValue(), pindex->GetBlockHash(), nMintsAdded);
 
         if (pindex->nHeight >= nHeightStop) {
             //If this height is within the invalid range (when fraudulent coins were being minted), then continue past this range
@@ -726,7 +850,8 @@ bool CalculateAccumulatorWitnessFor(
         int& nMintsAdded,
         std::string& strError,
         std::list<CBigNum>& ret,
-        int &heightStop
+        int &heightStop,
+        CAccumulatorRangeCache* pcache
 ){
     // Lock
     if (!LockMethod()) return false;
@@ -776,7 +901,8 @@ bool CalculateAccumulatorWitnessFor(
                 filter,
                 witnessAccumulator,
                 ret,
-                strError
+                strError,
+                pcache
         ))
             return error("CalculateAccumulatorWitnessFor(): Calculate accumulated coins failed");
 
@@ -904,8 +1030,7 @@ std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight()
         for (auto denom : libzerocoin::zerocoinDenomList) {
             //If the denom has not already had a mint added to it, then see if it has a mint added on this block
             if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-                mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-                                                          pindex->vMintDenominationsInBlock.end(), denom);
+                mapDenomMaturity.at(denom).first += pindex->GetMintCount(denom);
 
                 //if mint was found then record this block as the first block that maturity occurs.
                 if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
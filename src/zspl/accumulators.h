@@ -14,9 +14,54 @@
 #include "uint256.h"
 #include "bloom.h"
 #include "witness.h"
+#include "sync.h"
+
+#include <deque>
+#include <map>
+#include <tuple>
 
 class CBlockIndex;
 
+/** Number of partial accumulations kept by the light client witness server */
+static const size_t LIGHT_ACCUMULATOR_CACHE_SIZE = 1000;
+/** Distance in blocks between the partial accumulations stored while serving a request */
+static const int LIGHT_ACCUMULATOR_CACHE_INTERVAL = 100;
+
+/**
+ * Partial accumulations of every mint of a denomination over a height range,
+ * starting from a given base value. Light client requests from the same
+ * height share the prefix of the chain where none of their own coins appear,
+ * so that part only has to be raised once. The oldest entries are evicted first.
+ */
+class CAccumulatorRangeCache
+{
+private:
+    struct CEntry {
+        CBigNum bnBase;
+        CBigNum bnValue;
+        uint256 hashBlockTo;
+        int nMints;
+    };
+    typedef std::tuple<libzerocoin::CoinDenomination, int, int> RangeKey;
+
+    mutable CCriticalSection cs;
+    std::map<RangeKey, CEntry> mapEntries;
+    std::deque<RangeKey> dequeOrder;
+    size_t nMaxEntries;
+
+public:
+    explicit CAccumulatorRangeCache(size_t nMaxEntriesIn = LIGHT_ACCUMULATOR_CACHE_SIZE) : nMaxEntries(nMaxEntriesIn) {}
+
+    //! Store the accumulation of the mints in [nHeightFrom, nHeightTo), hashBlockTo being the block at nHeightTo
+    void Add(libzerocoin::CoinDenomination den, int nHeightFrom, int nHeightTo, const CBigNum& bnBase,
+             const CBigNum& bnValue, const uint256& hashBlockTo, int nMints);
+    //! Find the longest stored range from nHeightFrom over bnBase that ends at or before nHeightMax
+    bool GetLongest(libzerocoin::CoinDenomination den, int nHeightFrom, int nHeightMax, const CBigNum& bnBase,
+                    int& nHeightTo, CBigNum& bnValue, uint256& hashBlockTo, int& nMints) const;
+    size_t Size() const;
+    void Clear();
+};
+
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
 
 /**
@@ -35,7 +80,8 @@ bool CalculateAccumulatorWitnessFor(
         int& nMintsAdded,
         std::string& strError,
         std::list<CBigNum>& ret,
-        int &heightStop
+        int &heightStop,
+        CAccumulatorRangeCache* pcache = nullptr
 );
 
 bool GenerateAccumulatorWitness(
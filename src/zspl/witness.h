@@ -28,6 +28,7 @@ public:
     int nHeightMintAdded;
     int nHeightAccStart;
     int nHeightAccEnd;
+    uint256 hashBlockAccEnd; //! block at nHeightAccEnd, to detect reorgs below the accumulated range
     int nMintsAdded;
     uint256 txid;
     bool isV1;
@@ -48,6 +49,7 @@ public:
     int nHeightMintAdded;
     int nHeightAccStart;
     int nHeightAccEnd;
+    uint256 hashBlockAccEnd;
     int nMintsAdded;
     uint256 txid;
     bool isV1;
@@ -77,6 +79,7 @@ public:
         READWRITE(coinDenom);
         READWRITE(accumulatorAmount); // used to create the pAccumulator
         READWRITE(accumulatorDenom);
+        READWRITE(hashBlockAccEnd);
     };
 };
 #endif //SIMPLICITY_WITNESS_H
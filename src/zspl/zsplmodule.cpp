@@ -103,7 +103,7 @@ namespace ZSPLModule {
         return true;
     }
 
-    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction &tx, PublicCoinSpend &publicSpend) {
+    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction &tx, PublicCoinSpend &publicSpend, bool fValidate) {
         // Now prove that the commitment value opens to the input
         if (!parseCoinSpend(in, tx, prevOut, publicSpend)) {
             return false;
@@ -113,7 +113,7 @@ namespace ZSPLModule {
             return error("PublicCoinSpend validateInput :: input nSequence different to prevout value");
         }
 
-        return publicSpend.validate();
+        return !fValidate || publicSpend.validate();
     }
 
     bool ParseZerocoinPublicSpend(const CTxIn &txIn, const CTransaction& tx, CValidationState& state, PublicCoinSpend& publicSpend)
@@ -76,7 +76,8 @@ namespace ZSPLModule {
     bool createInput(CTxIn &in, CZerocoinMint& mint, uint256 hashTxOut);
     PublicCoinSpend parseCoinSpend(const CTxIn &in);
     bool parseCoinSpend(const CTxIn &in, const CTransaction& tx, const CTxOut &prevOut, PublicCoinSpend& publicCoinSpend);
-    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction& tx, PublicCoinSpend& ret);
+    //! Parse the spend and check it against its input; fValidate also checks the commitment and signature
+    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction& tx, PublicCoinSpend& ret, bool fValidate = true);
 
     // Public zc spend parse
     /**
@@ -11,6 +11,10 @@
 #include "deterministicmint.h"
 #include "zsplchain.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 
 CzSPLWallet::CzSPLWallet(std::string strWalletFile)
 {
@@ -103,7 +107,8 @@ void CzSPLWallet::AddToMintPool(const std::pair<uint256, uint32_t>& pMint, bool
 }
 
 //Add the next 20 mints to the mint pool
-void CzSPLWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
+//The mints are derived on up to nThreads threads (one per core by default) and stored in one wallet transaction
+void CzSPLWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd, int nThreads)
 {
 
     //Is locked
@@ -119,38 +124,64 @@ void CzSPLWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
     if (nCountEnd > 0)
         nStop = std::max(n, n + nCountEnd);
 
-    bool fFound;
-
-    uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
-    LogPrintf("%s : n=%d nStop=%d\n", __func__, n, nStop - 1);
+    // Prevent unnecessary repeated minted
+    std::vector<uint32_t> vCounts;
     for (uint32_t i = n; i < nStop; ++i) {
-        if (ShutdownRequested())
-            return;
+        if (!mintPool.HasCount(i))
+            vCounts.push_back(i);
+    }
 
-        fFound = false;
+    uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
+    LogPrintf("%s : n=%d nStop=%d new=%d\n", __func__, n, nStop - 1, vCounts.size());
+    if (vCounts.empty())
+        return;
 
-        // Prevent unnecessary repeated minted
-        for (auto& pair : mintPool) {
-            if(pair.second == i) {
-                fFound = true;
-                break;
+    // Each count is derived independently; a zero hash marks a count that was not reached
+    std::vector<uint256> vHashPubcoin(vCounts.size(), 0);
+    std::atomic<size_t> nNext(0);
+    auto worker = [this, &vCounts, &vHashPubcoin, &nNext]() {
+        try {
+            for (size_t j = nNext++; j < vCounts.size(); j = nNext++) {
+                if (ShutdownRequested())
+                    return;
+
+                uint512 seedZerocoin = GetZerocoinSeed(vCounts[j]);
+                CBigNum bnValue;
+                CBigNum bnSerial;
+                CBigNum bnRandomness;
+                CKey key;
+                SeedToZSPL(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
+                vHashPubcoin[j] = GetPubCoinHash(bnValue);
             }
+        } catch (const std::exception& e) {
+            LogPrintf("GenerateMintPool : %s\n", e.what());
         }
+    };
+
+    if (nThreads <= 0)
+        nThreads = std::min((int)boost::thread::hardware_concurrency(), MAX_MINTPOOL_THREADS);
+    nThreads = std::max(1, std::min(nThreads, (int)vCounts.size()));
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.create_thread([&worker]() {
+            RenameThread("simplicity-mintpool");
+            worker();
+        });
+    }
+    worker();
+    threads.join_all();
 
-        if(fFound)
+    CWalletDB walletdb(strWalletFile);
+    bool fTxn = walletdb.TxnBegin();
+    for (size_t j = 0; j < vCounts.size(); j++) {
+        if (vHashPubcoin[j] == 0)
             continue;
-
-        uint512 seedZerocoin = GetZerocoinSeed(i);
-        CBigNum bnValue;
-        CBigNum bnSerial;
-        CBigNum bnRandomness;
-        CKey key;
-        SeedToZSPL(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
-
-        mintPool.Add(bnValue, i);
-        CWalletDB(strWalletFile).WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), i);
-        LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), i);
+        mintPool.Add(std::make_pair(vHashPubcoin[j], vCounts[j]));
+        walletdb.WriteMintPoolPair(hashSeed, vHashPubcoin[j], vCounts[j]);
+        LogPrintf("%s : %s count=%d\n", __func__, vHashPubcoin[j].GetHex().substr(0, 6), vCounts[j]);
     }
+    if (fTxn && !walletdb.TxnCommit())
+        LogPrintf("%s : failed to commit mint pool to the wallet\n", __func__);
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without regenerating
@@ -371,8 +402,8 @@ void CzSPLWallet::SeedToZSPL(const uint512& seedZerocoin, CBigNum& bnValue, CBig
 
     //See if serial and randomness make a valid commitment
     // Generate a Pedersen commitment to the serial number
-    CBigNum commitmentValue = params->coinCommitmentGroup.g.pow_mod(bnSerial, params->coinCommitmentGroup.modulus).mul_mod(
-                        params->coinCommitmentGroup.h.pow_mod(bnRandomness, params->coinCommitmentGroup.modulus),
+    CBigNum commitmentValue = params->coinCommitmentGroup.powG(bnSerial).mul_mod(
+                        params->coinCommitmentGroup.powH(bnRandomness),
                         params->coinCommitmentGroup.modulus);
 
     CBigNum random;
@@ -394,7 +425,7 @@ void CzSPLWallet::SeedToZSPL(const uint512& seedZerocoin, CBigNum& bnValue, CBig
                               attempts256.begin(), attempts256.end());
         random.setuint256(hashRandomness);
         bnRandomness = (bnRandomness + random) % params->coinCommitmentGroup.groupOrder;
-        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.h.pow_mod(random, params->coinCommitmentGroup.modulus), params->coinCommitmentGroup.modulus);
+        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.powH(random), params->coinCommitmentGroup.modulus);
     }
 }
 
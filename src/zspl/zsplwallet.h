@@ -13,6 +13,9 @@
 
 class CDeterministicMint;
 
+//! Maximum number of threads deriving mint pool entries at once
+static const int MAX_MINTPOOL_THREADS = 16;
+
 class CzSPLWallet
 {
 private:
@@ -32,7 +35,7 @@ public:
     void GenerateMint(const uint32_t& nCount, const libzerocoin::CoinDenomination denom, libzerocoin::PrivateCoin& coin, CDeterministicMint& dMint);
     void GetState(int& nCount, int& nLastGenerated);
     bool RegenerateMint(const CDeterministicMint& dMint, CZerocoinMint& mint);
-    void GenerateMintPool(uint32_t nCountStart = 0, uint32_t nCountEnd = 0);
+    void GenerateMintPool(uint32_t nCountStart = 0, uint32_t nCountEnd = 0, int nThreads = 0);
     bool LoadMintPoolFromDB();
     void RemoveMintsFromPool(const std::vector<uint256>& vPubcoinHashes);
     bool SetMintSeen(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom);
@@ -4,6 +4,7 @@
 
 #include "zsplchain.h"
 #include "zspl/zsplmodule.h"
+#include "init.h"
 #include "invalid.h"
 #include "main.h"
 #include "txdb.h"
@@ -320,6 +321,10 @@ std::string ReindexZerocoinDB()
             }
         }
 
+        std::list<libzerocoin::PublicCoin> listPubcoins;
+        if (!BlockToPubcoinList(block, listPubcoins, true) || (!listPubcoins.empty() && !zerocoinDB->WriteBlockPubcoins(pindex, listPubcoins)))
+            return _("Error writing zerocoinDB to disk");
+
         // Flush the zerocoinDB to disk every 100 blocks
         if (pindex->nHeight % 100 == 0) {
             if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
@@ -341,6 +346,55 @@ std::string ReindexZerocoinDB()
     return "";
 }
 
+bool IndexBlockPubcoins()
+{
+    bool fIndexed = false;
+    if (zerocoinDB->ReadFlag("pubcoinindex", fIndexed) && fIndexed)
+        return true;
+
+    LOCK(cs_main);
+    int nStartHeight = std::max(Params().Zerocoin_StartHeight(), 1);
+    if (chainActive.Height() >= nStartHeight) {
+        LogPrintf("Indexing the pubcoins of blocks %d to %d...\n", nStartHeight, chainActive.Height());
+        uiInterface.InitMessage(_("Indexing zerocoin mints..."));
+    }
+
+    int nIndexed = 0;
+    int nReportedDone = -1;
+    bool fComplete = true;
+    for (int nHeight = nStartHeight; nHeight <= chainActive.Height(); nHeight++) {
+        if (ShutdownRequested())
+            return false;
+        const CBlockIndex* pindex = chainActive[nHeight];
+        std::list<libzerocoin::PublicCoin> listPubcoins;
+        if (zerocoinDB->ReadBlockPubcoins(pindex, listPubcoins))
+            continue;
+
+        // Blocks below a UTXO snapshot may not be downloaded yet, the next start indexes them
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            fComplete = false;
+            continue;
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex) || !BlockToPubcoinList(block, listPubcoins, true))
+            return error("%s : failed to read the pubcoins of block %d", __func__, nHeight);
+        if (!listPubcoins.empty()) {
+            if (!zerocoinDB->WriteBlockPubcoins(pindex, listPubcoins))
+                return error("%s : failed to write the pubcoins of block %d", __func__, nHeight);
+            nIndexed++;
+        }
+
+        int nDone = (nHeight - nStartHeight) * 100 / std::max(1, chainActive.Height() - nStartHeight);
+        if (nDone != nReportedDone) {
+            uiInterface.InitMessage(strprintf(_("Indexing zerocoin mints... (%d%%)"), nDone));
+            nReportedDone = nDone;
+        }
+    }
+    LogPrintf("Indexed the pubcoins of %d blocks%s\n", nIndexed, fComplete ? "" : ", blocks below the UTXO snapshot are missing");
+
+    return !fComplete || zerocoinDB->WriteFlag("pubcoinindex", true);
+}
+
 bool RemoveSerialFromDB(const CBigNum& bnSerial)
 {
     return zerocoinDB->EraseCoinSpend(bnSerial);